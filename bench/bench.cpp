@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "kernels.h"
+
+/*
+ * Kernel benchmarks for the conversion and image decode hot paths, plus
+ * end to end reader throughput for any videos given. Results can be saved
+ * as JSON and compared against an earlier run; the exit code is 1 when any
+ * case regressed past the threshold and its noise, so it can gate CI.
+ */
+static void Usage(const char* program) {
+    printf("Usage: %s [options] [video ...]\n"
+           "  --filter TEXT       only cases whose name contains TEXT\n"
+           "  --sizes WxH,...     image sizes (default 640x480,1280x720,1920x1080)\n"
+           "  --samples N         timed samples per case (default 15)\n"
+           "  --sample-ms MS      minimum length of one sample (default 20)\n"
+           "  --json FILE         write results as JSON\n"
+           "  --baseline FILE     compare medians against an earlier --json file\n"
+           "  --threshold PCT     slowdown counted as a regression (default 5)\n", program);
+}
+
+static bool ParseSizes(const char* text, std::vector<BenchSize>* sizes) {
+    sizes->clear();
+    while (*text) {
+        BenchSize size;
+        int consumed = 0;
+        if (sscanf(text, "%dx%d%n", &size.width, &size.height, &consumed) != 2 || size.width <= 0 || size.height <= 0)
+            return false;
+        sizes->push_back(size);
+        text += consumed;
+        if (*text == ',')
+            text++;
+    }
+    return !sizes->empty();
+}
+
+int main(int argc, char** argv)
+{
+    HarnessOptions options;
+    std::vector<BenchSize> sizes = { {640, 480}, {1280, 720}, {1920, 1080} };
+    const char* jsonPath = NULL;
+    const char* baselinePath = NULL;
+    double threshold = 5.0;
+    std::vector<const char*> videos;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            if (!ParseSizes(argv[++i], &sizes)) {
+                printf("Bad size list %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            options.samples = atoi(argv[++i]) > 0 ? atoi(argv[i]) : 1;
+        else if (strcmp(argv[i], "--sample-ms") == 0 && i + 1 < argc)
+            options.sampleSeconds = atof(argv[++i]) / 1000.0;
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--help") == 0 || argv[i][0] == '-') {
+            Usage(argv[0]);
+            return 1;
+        }
+        else
+            videos.push_back(argv[i]);
+    }
+
+    Harness harness(options);
+    RunStbBenchmarks(harness, sizes);
+    RunConvertBenchmarks(harness, sizes);
+    for (const char* video : videos)
+        RunReaderBenchmark(harness, video);
+
+    if (jsonPath)
+        harness.WriteJson(jsonPath);
+
+    int regressions = 0;
+    if (baselinePath) {
+        regressions = harness.CompareBaseline(baselinePath, threshold);
+        if (regressions < 0)
+            return 1;
+        printf("%d regression%s past %.1f%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+    }
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+
+#include "kernels.h"
+#include "media.h"
+#include "video_reader.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+/* One full frame through swscale, at display size and at the downscale the video wall uses */
+static void Yuv420ToRgb(Harness& harness, const BenchSize& size, int divisor, int flags, const char* variant) {
+    char name[128];
+    snprintf(name, sizeof(name), "convert/yuv420p_rgb24/%s/%dx%d", variant, size.width, size.height);
+    if (!harness.Enabled(name))
+        return;
+
+    const int outWidth = size.width / divisor;
+    const int outHeight = size.height / divisor;
+    if (outWidth <= 0 || outHeight <= 0) {
+        printf("Skipping %s, the output would be empty\n", name);
+        return;
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    if (frame) {
+        frame->format = AV_PIX_FMT_YUV420P;
+        frame->width = size.width;
+        frame->height = size.height;
+    }
+    SwsContext* swsCtx = sws_getContext(size.width, size.height, AV_PIX_FMT_YUV420P, outWidth, outHeight,
+                                        AV_PIX_FMT_RGB24, flags, NULL, NULL, NULL);
+    if (!frame || !swsCtx || av_frame_get_buffer(frame, 0) < 0) {
+        printf("Skipping %s, couldn't set up the frame or the converter\n", name);
+        sws_freeContext(swsCtx);
+        av_frame_free(&frame);
+        return;
+    }
+    for (int plane = 0; plane < 3; plane++) {
+        int w = plane ? (size.width + 1) / 2 : size.width;
+        int h = plane ? (size.height + 1) / 2 : size.height;
+        for (int y = 0; y < h; y++)
+            FillPattern(frame->data[plane] + (size_t)y * frame->linesize[plane], w, 1, 1, 8 + plane, y);
+    }
+
+    std::vector<unsigned char> rgb((size_t)outWidth * outHeight * 3);
+    uint8_t* dst[4] = { rgb.data(), NULL, NULL, NULL };
+    int dstStride[4] = { outWidth * 3, 0, 0, 0 };
+
+    harness.Run(name, rgb.size(), [&] {
+        sws_scale(swsCtx, frame->data, frame->linesize, 0, size.height, dst, dstStride);
+        KeepAlive(rgb.data());
+    });
+
+    sws_freeContext(swsCtx);
+    av_frame_free(&frame);
+}
+
+void RunConvertBenchmarks(Harness& harness, const std::vector<BenchSize>& sizes) {
+    for (const BenchSize& size : sizes) {
+        Yuv420ToRgb(harness, size, 1, SWS_BILINEAR, "bilinear");
+        Yuv420ToRgb(harness, size, 4, SWS_AREA, "area_quarter");
+    }
+}
+
+void RunReaderBenchmark(Harness& harness, const char* filename) {
+    VideoReader reader;
+    if (!reader.Open(filename)) {
+        printf("Couldn't open %s\n", filename);
+        return;
+    }
+
+    char name[128];
+    snprintf(name, sizeof(name), "reader/decode_convert/%dx%d", reader.Width(), reader.Height());
+    PixelBuffer rgb;
+    int64_t pts;
+    harness.Run(name, (uint64_t)reader.Width() * reader.Height() * 3, [&] {
+        reader.ReadFrame(&rgb, &pts);
+        KeepAlive(rgb.data());
+    });
+}
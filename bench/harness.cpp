@@ -0,0 +1,189 @@
+#include "harness.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+using Clock = std::chrono::steady_clock;
+
+/* A normal distribution's standard deviation is 1.4826 times its MAD */
+constexpr double MadToSigma = 1.4826;
+constexpr double NoiseSigmas = 3.0;
+
+static volatile const void* keepAliveSink;
+
+void KeepAlive(const void* pointer) {
+    keepAliveSink = pointer;
+}
+
+static double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) * 0.5;
+}
+
+bool Harness::Enabled(const std::string& name) const {
+    return !options.filter || name.find(options.filter) != std::string::npos;
+}
+
+void Harness::Run(const std::string& name, uint64_t bytes, const std::function<void()>& body) {
+    if (!Enabled(name))
+        return;
+
+    /* Warm caches and find how many iterations fill a sample */
+    uint64_t iterations = 1;
+    for (;;) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            body();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= options.sampleSeconds || iterations >= (1ull << 30))
+            break;
+        uint64_t target = seconds > 0 ? (uint64_t)(iterations * options.sampleSeconds / seconds * 1.1) : iterations * 10;
+        iterations = std::max(iterations * 2, std::min(target, iterations * 100));
+    }
+
+    std::vector<double> perIteration;
+    for (int s = 0; s < options.samples; s++) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            body();
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        perIteration.push_back(ns / iterations);
+    }
+    Finish(name, bytes, iterations, perIteration);
+}
+
+void Harness::RunWithSetup(const std::string& name, uint64_t bytes, const std::function<void()>& setup,
+                           const std::function<void()>& body) {
+    if (!Enabled(name))
+        return;
+
+    setup();
+    body();
+
+    std::vector<double> perIteration;
+    uint64_t iterations = 0;
+    for (int s = 0; s < options.samples; s++) {
+        double ns = 0;
+        uint64_t n = 0;
+        /* At least one iteration, then keep going until the timed part fills the sample */
+        while (n == 0 || ns < options.sampleSeconds * 1e9) {
+            setup();
+            auto start = Clock::now();
+            body();
+            ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            n++;
+        }
+        perIteration.push_back(ns / n);
+        iterations = std::max(iterations, n);
+    }
+    Finish(name, bytes, iterations, perIteration);
+}
+
+void Harness::Finish(const std::string& name, uint64_t bytes, uint64_t iterations, std::vector<double>& perIteration) {
+    BenchResult result;
+    result.name = name;
+    result.bytes = bytes;
+    result.samples = (int)perIteration.size();
+    result.iterations = iterations;
+    result.medianNs = Median(perIteration);
+    result.minNs = *std::min_element(perIteration.begin(), perIteration.end());
+
+    double sum = 0;
+    for (double ns : perIteration)
+        sum += ns;
+    result.meanNs = sum / perIteration.size();
+    double squares = 0;
+    for (double ns : perIteration)
+        squares += (ns - result.meanNs) * (ns - result.meanNs);
+    result.stddevNs = perIteration.size() > 1 ? sqrt(squares / (perIteration.size() - 1)) : 0;
+
+    std::vector<double> deviations;
+    for (double ns : perIteration)
+        deviations.push_back(fabs(ns - result.medianNs));
+    result.madNs = Median(deviations);
+
+    double throughput = bytes && result.medianNs > 0 ? bytes / result.medianNs * 1e9 / (1024.0 * 1024.0) : 0;
+    printf("%-48s %12.1f ns  +-%5.1f%%  %9.1f MB/s\n", name.c_str(), result.medianNs,
+           result.medianNs > 0 ? result.madNs / result.medianNs * 100.0 : 0.0, throughput);
+    fflush(stdout);
+    results.push_back(result);
+}
+
+bool Harness::WriteJson(const char* path) const {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Couldn't write results to %s\n", path);
+        return false;
+    }
+
+    /* One case per line, CompareBaseline relies on that */
+    fprintf(file, "{\n  \"unit\": \"ns\",\n  \"samples\": %d,\n  \"results\": [\n", options.samples);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(file,
+                "    { \"name\": \"%s\", \"bytes\": %llu, \"iterations\": %llu, \"median_ns\": %.1f, "
+                "\"mean_ns\": %.1f, \"stddev_ns\": %.1f, \"mad_ns\": %.1f, \"min_ns\": %.1f }%s\n",
+                r.name.c_str(), (unsigned long long)r.bytes, (unsigned long long)r.iterations, r.medianNs,
+                r.meanNs, r.stddevNs, r.madNs, r.minNs, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+int Harness::CompareBaseline(const char* path, double thresholdPercent) const {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("Couldn't read baseline %s\n", path);
+        return -1;
+    }
+
+    struct Baseline {
+        double medianNs;
+        double madNs;
+    };
+    std::map<std::string, Baseline> baseline;
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        const char* name = strstr(line, "\"name\": \"");
+        const char* median = strstr(line, "\"median_ns\": ");
+        const char* mad = strstr(line, "\"mad_ns\": ");
+        if (!name || !median)
+            continue;
+        name += strlen("\"name\": \"");
+        const char* end = strchr(name, '"');
+        if (end)
+            baseline[std::string(name, end)] = { atof(median + strlen("\"median_ns\": ")),
+                                                 mad ? atof(mad + strlen("\"mad_ns\": ")) : 0.0 };
+    }
+    fclose(file);
+
+    int regressions = 0;
+    printf("\n%-48s %12s %12s %8s %8s\n", "case", "baseline", "current", "change", "noise");
+    for (const BenchResult& r : results) {
+        auto found = baseline.find(r.name);
+        if (found == baseline.end() || found->second.medianNs <= 0)
+            continue;
+        const double before = found->second.medianNs;
+        double change = (r.medianNs / before - 1.0) * 100.0;
+
+        /*
+         * The MADs of both runs, scaled to standard deviations and added in
+         * quadrature, give the spread of the difference; a slowdown within
+         * NoiseSigmas of it is not told apart from sample noise.
+         */
+        const double sigma = MadToSigma * sqrt(found->second.madNs * found->second.madNs + r.madNs * r.madNs);
+        double noise = NoiseSigmas * sigma / before * 100.0;
+        bool regressed = change > thresholdPercent && change > noise;
+        regressions += regressed ? 1 : 0;
+        printf("%-48s %12.1f %12.1f %+7.1f%% %7.1f%%%s\n", r.name.c_str(), before, r.medianNs, change, noise,
+               regressed ? "  REGRESSION" : change > thresholdPercent ? "  (within noise)" : "");
+    }
+    return regressions;
+}
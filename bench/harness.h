@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchResult {
+    std::string name;
+    uint64_t bytes = 0;         // data processed per iteration
+    int samples = 0;
+    uint64_t iterations = 0;    // per sample
+    double medianNs = 0;        // per iteration
+    double meanNs = 0;
+    double stddevNs = 0;
+    double madNs = 0;           // median absolute deviation, robust to outliers
+    double minNs = 0;
+};
+
+struct HarnessOptions {
+    const char* filter = nullptr;   // substring a case name must contain
+    int samples = 15;
+    double sampleSeconds = 0.02;    // each sample runs enough iterations to last this long
+};
+
+/*
+ * Runs each case for a warmup sample and a fixed number of timed samples;
+ * one sample repeats the body until it lasts long enough that clock
+ * resolution doesn't matter. The median per-iteration time is what gets
+ * compared against baselines.
+ */
+class Harness {
+public:
+    explicit Harness(const HarnessOptions& options) : options(options) {}
+
+    bool Enabled(const std::string& name) const;
+
+    void Run(const std::string& name, uint64_t bytes, const std::function<void()>& body);
+    /* setup runs before every iteration, untimed, for kernels that consume their input */
+    void RunWithSetup(const std::string& name, uint64_t bytes, const std::function<void()>& setup,
+                      const std::function<void()>& body);
+
+    const std::vector<BenchResult>& Results() const { return results; }
+    bool WriteJson(const char* path) const;
+    /*
+     * Prints every case whose median got slower than the baseline by more
+     * than thresholdPercent and by more than three standard deviations of
+     * sample noise, estimated from the MADs of both runs. Returns how many.
+     */
+    int CompareBaseline(const char* path, double thresholdPercent) const;
+
+private:
+    void Finish(const std::string& name, uint64_t bytes, uint64_t iterations, std::vector<double>& perIteration);
+
+    HarnessOptions options;
+    std::vector<BenchResult> results;
+};
+
+/* Keeps the optimizer from dropping work whose result is otherwise unused */
+void KeepAlive(const void* pointer);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+#include "harness.h"
+
+struct BenchSize {
+    int width;
+    int height;
+};
+
+/* stb_image internals: format conversion, flips, PNG, zlib, JPEG and HDR paths */
+void RunStbBenchmarks(Harness& harness, const std::vector<BenchSize>& sizes);
+/* The swscale YUV to RGB pass the reader runs for every frame */
+void RunConvertBenchmarks(Harness& harness, const std::vector<BenchSize>& sizes);
+/* Demux, decode and convert through VideoReader */
+void RunReaderBenchmark(Harness& harness, const char* filename);
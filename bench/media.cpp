@@ -0,0 +1,324 @@
+#include "media.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+static uint32_t Hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+void FillPattern(unsigned char* pixels, int width, int height, int channels, uint32_t seed, int frame) {
+    const int bar = width > 0 ? (frame * 8) % width : 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint32_t noise = Hash(seed ^ (uint32_t)(y * width + x) ^ ((uint32_t)frame << 24));
+            int r = x * 255 / (width > 1 ? width - 1 : 1);
+            int g = y * 255 / (height > 1 ? height - 1 : 1);
+            int b = (x + y + frame * 4) & 255;
+            if (x >= bar && x < bar + width / 16) {
+                r = 255 - r;
+                g = 255 - g;
+            }
+            int jitter = (int)(noise & 7) - 4;
+            unsigned char* p = pixels + ((size_t)y * width + x) * channels;
+            unsigned char luma = (unsigned char)((r * 77 + g * 150 + b * 29) >> 8);
+            switch (channels) {
+            case 1: p[0] = (unsigned char)std::clamp(luma + jitter, 0, 255); break;
+            case 2: p[0] = (unsigned char)std::clamp(luma + jitter, 0, 255); p[1] = (unsigned char)(x ^ y); break;
+            default:
+                p[0] = (unsigned char)std::clamp(r + jitter, 0, 255);
+                p[1] = (unsigned char)std::clamp(g + jitter, 0, 255);
+                p[2] = (unsigned char)std::clamp(b + jitter, 0, 255);
+                if (channels == 4)
+                    p[3] = (unsigned char)(255 - ((x ^ y) & 63));
+                break;
+            }
+        }
+    }
+}
+
+static AVPixelFormat PackedFormat(int channels) {
+    switch (channels) {
+    case 1: return AV_PIX_FMT_GRAY8;
+    case 2: return AV_PIX_FMT_YA8;
+    case 3: return AV_PIX_FMT_RGB24;
+    default: return AV_PIX_FMT_RGBA;
+    }
+}
+
+/* The packed layout when the encoder takes it, otherwise its first format */
+static AVPixelFormat EncoderFormat(const AVCodec* codec, AVPixelFormat source) {
+    for (const AVPixelFormat* f = codec->pix_fmts; f && *f != AV_PIX_FMT_NONE; f++) {
+        if (*f == source)
+            return source;
+    }
+    return codec->pix_fmts ? codec->pix_fmts[0] : source;
+}
+
+bool EncodeImage(const char* encoder, const unsigned char* pixels, int width, int height, int channels,
+                 std::vector<unsigned char>* out) {
+    const AVCodec* codec = avcodec_find_encoder_by_name(encoder);
+    if (!codec) {
+        printf("No %s encoder in this libavcodec\n", encoder);
+        return false;
+    }
+
+    AVPixelFormat source = PackedFormat(channels);
+    AVPixelFormat target = EncoderFormat(codec, source);
+
+    AVCodecContext* codecCtx = avcodec_alloc_context3(codec);
+    if (!codecCtx) {
+        printf("Couldn't allocate %s encoder\n", encoder);
+        return false;
+    }
+    codecCtx->width = width;
+    codecCtx->height = height;
+    codecCtx->pix_fmt = target;
+    codecCtx->time_base = AVRational{1, 25};
+    codecCtx->color_range = AVCOL_RANGE_JPEG;
+    if (avcodec_open2(codecCtx, codec, NULL) < 0) {
+        printf("Couldn't open %s encoder\n", encoder);
+        avcodec_free_context(&codecCtx);
+        return false;
+    }
+
+    bool ok = false;
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* packet = av_packet_alloc();
+    SwsContext* swsCtx = sws_getContext(width, height, source, width, height, target, SWS_BICUBIC, NULL, NULL, NULL);
+    if (frame) {
+        frame->format = target;
+        frame->width = width;
+        frame->height = height;
+    }
+    if (!frame || !packet || !swsCtx || av_frame_get_buffer(frame, 0) < 0) {
+        printf("Couldn't set up a %dx%d frame for the %s encoder\n", width, height, encoder);
+    } else {
+        const uint8_t* src[4] = { pixels, NULL, NULL, NULL };
+        const int srcStride[4] = { width * channels, 0, 0, 0 };
+        sws_scale(swsCtx, src, srcStride, 0, height, frame->data, frame->linesize);
+
+        if (avcodec_send_frame(codecCtx, frame) >= 0 && avcodec_send_frame(codecCtx, NULL) >= 0) {
+            out->clear();
+            while (avcodec_receive_packet(codecCtx, packet) >= 0) {
+                out->insert(out->end(), packet->data, packet->data + packet->size);
+                av_packet_unref(packet);
+                ok = true;
+            }
+        }
+    }
+
+    sws_freeContext(swsCtx);
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&codecCtx);
+    return ok;
+}
+
+std::vector<unsigned char> PngZlibStream(const std::vector<unsigned char>& png) {
+    std::vector<unsigned char> stream;
+    size_t at = 8;
+    while (at + 12 <= png.size()) {
+        uint32_t length = (uint32_t)png[at] << 24 | png[at + 1] << 16 | png[at + 2] << 8 | png[at + 3];
+        if (at + 12 + length > png.size())
+            break;
+        if (memcmp(&png[at + 4], "IDAT", 4) == 0)
+            stream.insert(stream.end(), png.begin() + at + 8, png.begin() + at + 8 + length);
+        at += 12 + length;
+    }
+    return stream;
+}
+
+static bool WritePackets(AVFormatContext* formatCtx, AVCodecContext* codecCtx, AVStream* stream, AVFrame* frame,
+                         AVPacket* packet) {
+    if (avcodec_send_frame(codecCtx, frame) < 0)
+        return false;
+
+    int ret;
+    while ((ret = avcodec_receive_packet(codecCtx, packet)) >= 0) {
+        av_packet_rescale_ts(packet, codecCtx->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+        if (av_interleaved_write_frame(formatCtx, packet) < 0)
+            return false;
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+}
+
+bool WriteClip(const char* path, const ClipSettings& settings) {
+    AVFormatContext* formatCtx = nullptr;
+    avformat_alloc_output_context2(&formatCtx, NULL, NULL, path);
+    if (!formatCtx) {
+        printf("Couldn't guess a container for %s\n", path);
+        return false;
+    }
+
+    const AVCodec* codec = settings.encoder ? avcodec_find_encoder_by_name(settings.encoder)
+                                            : avcodec_find_encoder(formatCtx->oformat->video_codec);
+    if (!codec) {
+        printf("No %s encoder in this libavcodec\n", settings.encoder ? settings.encoder : "default");
+        avformat_free_context(formatCtx);
+        return false;
+    }
+
+    const AVPixelFormat source = PackedFormat(settings.channels);
+    AVCodecContext* codecCtx = avcodec_alloc_context3(codec);
+    if (!codecCtx) {
+        printf("Couldn't allocate encoder %s\n", codec->name);
+        avformat_free_context(formatCtx);
+        return false;
+    }
+    codecCtx->width = settings.width;
+    codecCtx->height = settings.height;
+    codecCtx->pix_fmt = EncoderFormat(codec, source);
+    codecCtx->time_base = AVRational{1, settings.frameRate};
+    codecCtx->framerate = AVRational{settings.frameRate, 1};
+    codecCtx->gop_size = settings.gop;
+    codecCtx->bit_rate = settings.bitRate;
+    codecCtx->color_range = AVCOL_RANGE_JPEG;
+    codecCtx->thread_count = 1;
+    codecCtx->flags |= AV_CODEC_FLAG_BITEXACT;
+    if (formatCtx->oformat->flags & AVFMT_GLOBALHEADER)
+        codecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    formatCtx->flags |= AVFMT_FLAG_BITEXACT;
+
+    AVStream* stream = nullptr;
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* packet = av_packet_alloc();
+    SwsContext* swsCtx = nullptr;
+    bool ok = false;
+
+    if (avcodec_open2(codecCtx, codec, NULL) < 0) {
+        printf("Couldn't open encoder %s\n", codec->name);
+    } else if (!(stream = avformat_new_stream(formatCtx, NULL))) {
+        printf("Couldn't add a stream to %s\n", path);
+    } else {
+        stream->time_base = codecCtx->time_base;
+        avcodec_parameters_from_context(stream->codecpar, codecCtx);
+
+        /* Everything the frame loop needs exists before the file is touched */
+        swsCtx = sws_getContext(settings.width, settings.height, source, settings.width, settings.height,
+                                codecCtx->pix_fmt, SWS_BICUBIC | SWS_ACCURATE_RND | SWS_BITEXACT, NULL, NULL, NULL);
+        if (frame) {
+            frame->format = codecCtx->pix_fmt;
+            frame->width = settings.width;
+            frame->height = settings.height;
+        }
+
+        /* The image muxer wants a frame number in the name unless it is told to overwrite one file */
+        AVDictionary* muxerOptions = NULL;
+        if (strcmp(formatCtx->oformat->name, "image2") == 0)
+            av_dict_set(&muxerOptions, "update", "1", 0);
+
+        if (!frame || !packet || !swsCtx || av_frame_get_buffer(frame, 0) < 0) {
+            printf("Couldn't set up a %dx%d frame for encoder %s\n", settings.width, settings.height, codec->name);
+        } else if (!(formatCtx->oformat->flags & AVFMT_NOFILE) && avio_open(&formatCtx->pb, path, AVIO_FLAG_WRITE) < 0) {
+            printf("Couldn't open %s for writing\n", path);
+        } else if (avformat_write_header(formatCtx, &muxerOptions) < 0) {
+            printf("Couldn't write the %s header\n", formatCtx->oformat->name);
+        } else {
+            std::vector<unsigned char> pixels((size_t)settings.width * settings.height * settings.channels);
+            const uint8_t* src[4] = { pixels.data(), NULL, NULL, NULL };
+            const int srcStride[4] = { settings.width * settings.channels, 0, 0, 0 };
+
+            ok = true;
+            for (int i = 0; i < settings.frames && ok; i++) {
+                FillPattern(pixels.data(), settings.width, settings.height, settings.channels, settings.seed, i);
+                ok = av_frame_make_writable(frame) >= 0;
+                if (!ok)
+                    break;
+                sws_scale(swsCtx, src, srcStride, 0, settings.height, frame->data, frame->linesize);
+                frame->pts = i;
+                ok = WritePackets(formatCtx, codecCtx, stream, frame, packet);
+            }
+            ok = ok && WritePackets(formatCtx, codecCtx, stream, NULL, packet);
+            ok = av_write_trailer(formatCtx) >= 0 && ok;
+        }
+        av_dict_free(&muxerOptions);
+    }
+
+    if (!(formatCtx->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&formatCtx->pb);
+    sws_freeContext(swsCtx);
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&codecCtx);
+    avformat_free_context(formatCtx);
+    return ok;
+}
+
+static void WriteRgbeRun(FILE* file, const unsigned char* values, int count) {
+    /* Literal runs only, at most 128 bytes each; the reader needs no repeats to decode it */
+    while (count > 0) {
+        int n = count < 128 ? count : 128;
+        fputc(n, file);
+        fwrite(values, 1, n, file);
+        values += n;
+        count -= n;
+    }
+}
+
+bool WriteHdr(const char* path, int width, int height, uint32_t seed) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        printf("Couldn't open %s for writing\n", path);
+        return false;
+    }
+
+    fprintf(file, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", height, width);
+
+    std::vector<unsigned char> pixels((size_t)width * height * 3);
+    FillPattern(pixels.data(), width, height, 3, seed);
+    std::vector<unsigned char> planes((size_t)width * 4);
+    const bool runLength = width >= 8 && width < 32768;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            /* Brightness grows along x to about 2^6, so tone mapping has something to do */
+            const unsigned char* p = &pixels[((size_t)y * width + x) * 3];
+            float gain = exp2f(6.0f * x / (width > 1 ? width - 1 : 1)) / 255.0f;
+            float rgb[3] = { p[0] * gain, p[1] * gain, p[2] * gain };
+            float largest = fmaxf(rgb[0], fmaxf(rgb[1], rgb[2]));
+            unsigned char rgbe[4] = { 0, 0, 0, 0 };
+            if (largest >= 1e-32f) {
+                int exponent;
+                float scale = frexpf(largest, &exponent) * 256.0f / largest;
+                for (int c = 0; c < 3; c++)
+                    rgbe[c] = (unsigned char)(rgb[c] * scale);
+                rgbe[3] = (unsigned char)(exponent + 128);
+            }
+            for (int c = 0; c < 4; c++)
+                planes[(size_t)c * width + x] = rgbe[c];
+        }
+
+        if (runLength) {
+            const unsigned char header[4] = { 2, 2, (unsigned char)(width >> 8), (unsigned char)(width & 255) };
+            fwrite(header, 1, 4, file);
+            for (int c = 0; c < 4; c++)
+                WriteRgbeRun(file, &planes[(size_t)c * width], width);
+        } else {
+            for (int x = 0; x < width; x++) {
+                for (int c = 0; c < 4; c++)
+                    fputc(planes[(size_t)c * width + x], file);
+            }
+        }
+    }
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
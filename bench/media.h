@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Deterministic test content: smooth gradients with a moving bar and a
+ * little hash noise, so encoded images compress like camera content
+ * instead of flat fills. The same seed and frame always give the same pixels.
+ */
+void FillPattern(unsigned char* pixels, int width, int height, int channels, uint32_t seed, int frame = 0);
+
+/* Encodes one image with a libavcodec image encoder such as "png" or "mjpeg", channels 1 to 4 */
+bool EncodeImage(const char* encoder, const unsigned char* pixels, int width, int height, int channels,
+                 std::vector<unsigned char>* out);
+
+/* The concatenated IDAT payloads of a PNG file, which form one zlib stream */
+std::vector<unsigned char> PngZlibStream(const std::vector<unsigned char>& png);
+
+struct ClipSettings {
+    const char* encoder = nullptr;  // libavcodec encoder name, nullptr takes the container's default
+    int width = 1280;
+    int height = 720;
+    int channels = 3;               // source layout, images may keep alpha or be grayscale
+    int frameRate = 30;
+    int gop = 30;
+    int64_t bitRate = 4000000;
+    int frames = 150;
+    uint32_t seed = 1;
+};
+
+/*
+ * Encodes FillPattern frames into a file, the container follows the
+ * extension. A single frame to .png, .jpg or .gif writes a plain image.
+ * Encoders run single threaded with bit-exact flags so the same settings
+ * give the same bytes on every run of the same FFmpeg build.
+ */
+bool WriteClip(const char* path, const ClipSettings& settings);
+
+/* Radiance RGBE with run-length scanlines, the pattern scaled into a high dynamic range */
+bool WriteHdr(const char* path, int width, int height, uint32_t seed);
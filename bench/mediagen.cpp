@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <filesystem>
+#include <string>
+
+#include "media.h"
+
+/*
+ * Writes deterministic test media: clips at a chosen codec, size, rate, GOP
+ * and bitrate, and PNG, JPEG, GIF or Radiance HDR stills. "suite" writes the
+ * fixed set the benchmarks expect, so runs are reproducible without
+ * downloads or binaries in the repository.
+ */
+static void Usage(const char* program) {
+    printf("Usage:\n"
+           "  %s clip OUT [--encoder NAME] [--size WxH] [--fps N] [--gop N] [--bitrate BPS] [--frames N] [--seed N]\n"
+           "  %s image OUT.{png,jpg,gif,hdr} [--size WxH] [--channels N] [--seed N]\n"
+           "  %s suite DIR\n", program, program, program);
+}
+
+static bool EndsWith(const char* text, const char* suffix) {
+    size_t length = strlen(text), suffixLength = strlen(suffix);
+    return length >= suffixLength && strcmp(text + length - suffixLength, suffix) == 0;
+}
+
+static bool WriteImage(const char* path, int width, int height, int channels, uint32_t seed) {
+    if (EndsWith(path, ".hdr"))
+        return WriteHdr(path, width, height, seed);
+
+    ClipSettings settings;
+    settings.width = width;
+    settings.height = height;
+    settings.channels = channels;
+    settings.frames = 1;
+    settings.seed = seed;
+    return WriteClip(path, settings);
+}
+
+static bool WriteSuite(const char* directory) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    static const int sizes[][2] = { {640, 480}, {1280, 720}, {1920, 1080} };
+    bool ok = true;
+    int written = 0;
+    for (const auto& size : sizes) {
+        char base[64];
+        snprintf(base, sizeof(base), "%s/pattern-%dx%d", directory, size[0], size[1]);
+        struct { const char* suffix; int channels; } images[] = {
+            { ".png", 3 }, { "-rgba.png", 4 }, { "-gray.png", 1 }, { ".jpg", 3 }, { ".gif", 3 }, { ".hdr", 3 },
+        };
+        for (const auto& image : images) {
+            std::string path = std::string(base) + image.suffix;
+            bool wrote = WriteImage(path.c_str(), size[0], size[1], image.channels, 1);
+            ok = ok && wrote;
+            written += wrote ? 1 : 0;
+        }
+    }
+
+    /* The container's default encoder, H.264 in MP4 when libx264 is built in */
+    static const int clips[][2] = { {1280, 720}, {1920, 1080} };
+    for (const auto& size : clips) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/clip-%dp30-gop30.mp4", directory, size[1]);
+        ClipSettings settings;
+        settings.width = size[0];
+        settings.height = size[1];
+        settings.frames = 120;
+        settings.bitRate = (int64_t)size[0] * size[1] * 4;
+        bool wrote = WriteClip(path, settings);
+        ok = ok && wrote;
+        written += wrote ? 1 : 0;
+    }
+
+    printf("Wrote %d files to %s\n", written, directory);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    const char* mode = argv[1];
+    const char* out = argv[2];
+    if (strcmp(mode, "suite") == 0)
+        return WriteSuite(out) ? 0 : 1;
+
+    ClipSettings settings;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--encoder") == 0 && i + 1 < argc)
+            settings.encoder = argv[++i];
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            sscanf(argv[++i], "%dx%d", &settings.width, &settings.height);
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+            settings.frameRate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--gop") == 0 && i + 1 < argc)
+            settings.gop = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bitrate") == 0 && i + 1 < argc)
+            settings.bitRate = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            settings.frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc)
+            settings.channels = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            settings.seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (settings.width <= 0 || settings.height <= 0 || settings.frameRate <= 0 || settings.frames <= 0 ||
+        settings.channels < 1 || settings.channels > 4) {
+        printf("Invalid settings\n");
+        return 1;
+    }
+
+    bool ok;
+    if (strcmp(mode, "clip") == 0)
+        ok = WriteClip(out, settings);
+    else if (strcmp(mode, "image") == 0)
+        ok = WriteImage(out, settings.width, settings.height, settings.channels, settings.seed);
+    else {
+        Usage(argv[0]);
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,311 @@
+/*
+ * Links its own private copy of stb_image so the static kernels can be
+ * called one at a time; the core library's copy carries the profiler and
+ * allocation hooks, which would otherwise be measured along with them.
+ */
+#if defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "../lib/stb/stb_image.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernels.h"
+#include "media.h"
+
+static std::string CaseName(const char* kernel, const char* variant, const BenchSize& size) {
+    char name[128];
+    if (variant)
+        snprintf(name, sizeof(name), "stb/%s/%s/%dx%d", kernel, variant, size.width, size.height);
+    else
+        snprintf(name, sizeof(name), "stb/%s/%dx%d", kernel, size.width, size.height);
+    return name;
+}
+
+/* Encoding a test image is slow, so it is skipped when the filter rules out every case using it */
+static bool AnyEnabled(const Harness& harness, const std::vector<std::string>& names) {
+    for (const std::string& name : names) {
+        if (harness.Enabled(name))
+            return true;
+    }
+    return false;
+}
+
+static void ConvertFormat(Harness& harness, const BenchSize& size) {
+    static const int pairs[][2] = { {1, 3}, {3, 4}, {4, 3}, {3, 1} };
+    for (const auto& pair : pairs) {
+        const int from = pair[0], to = pair[1];
+        const size_t bytes = (size_t)size.width * size.height * from;
+        std::vector<unsigned char> source(bytes);
+        FillPattern(source.data(), size.width, size.height, from, 1);
+
+        char variant[16];
+        snprintf(variant, sizeof(variant), "%dto%d", from, to);
+        unsigned char* input = nullptr;
+        unsigned char* output = nullptr;
+        harness.RunWithSetup(CaseName("convert_format", variant, size), bytes,
+            [&] {
+                free(output);
+                output = nullptr;
+                input = (unsigned char*)malloc(bytes);
+                memcpy(input, source.data(), bytes);
+            },
+            [&] { output = stbi__convert_format(input, from, to, size.width, size.height); });
+        free(output);
+    }
+}
+
+static void VerticalFlip(Harness& harness, const BenchSize& size) {
+    for (int channels : {1, 3, 4}) {
+        std::vector<unsigned char> image((size_t)size.width * size.height * channels);
+        FillPattern(image.data(), size.width, size.height, channels, 2);
+        char variant[8];
+        snprintf(variant, sizeof(variant), "c%d", channels);
+        harness.Run(CaseName("vertical_flip", variant, size), image.size(), [&] {
+            stbi__vertical_flip(image.data(), size.width, size.height, channels);
+            KeepAlive(image.data());
+        });
+    }
+}
+
+static void PngUnfilter(Harness& harness, const BenchSize& size) {
+    for (int channels : {1, 3, 4}) {
+        /* Every filter type in turn, so the mix matches what encoders pick on photos */
+        const size_t rowBytes = (size_t)size.width * channels;
+        std::vector<unsigned char> raw((rowBytes + 1) * size.height);
+        std::vector<unsigned char> pixels(rowBytes * size.height);
+        FillPattern(pixels.data(), size.width, size.height, channels, 3);
+        for (int y = 0; y < size.height; y++) {
+            raw[y * (rowBytes + 1)] = (unsigned char)(y % 5);
+            memcpy(&raw[y * (rowBytes + 1) + 1], &pixels[y * rowBytes], rowBytes);
+        }
+
+        stbi__context context;
+        memset(&context, 0, sizeof(context));
+        context.img_x = size.width;
+        context.img_y = size.height;
+        context.img_n = channels;
+        stbi__png png;
+        memset(&png, 0, sizeof(png));
+        png.s = &context;
+        const int color = channels == 1 ? 0 : channels == 2 ? 4 : channels == 3 ? 2 : 6;
+
+        char variant[8];
+        snprintf(variant, sizeof(variant), "c%d", channels);
+        harness.Run(CaseName("png_unfilter", variant, size), pixels.size(), [&] {
+            stbi__create_png_image_raw(&png, raw.data(), (stbi__uint32)raw.size(), channels,
+                                       size.width, size.height, 8, color);
+            KeepAlive(png.out);
+            free(png.out);
+            png.out = nullptr;
+        });
+    }
+}
+
+/* Row callback for the streaming loads, the rows only have to be touched */
+static void KeepRows(void*, int, int, const stbi_uc* pixels) {
+    KeepAlive(pixels);
+}
+
+static void PngAndZlib(Harness& harness, const BenchSize& size) {
+    if (!AnyEnabled(harness, { CaseName("zlib_inflate", nullptr, size), CaseName("png_decode", nullptr, size),
+                               CaseName("png_decode", "rows", size) }))
+        return;
+    std::vector<unsigned char> pixels((size_t)size.width * size.height * 3);
+    FillPattern(pixels.data(), size.width, size.height, 3, 4);
+    std::vector<unsigned char> png;
+    if (!EncodeImage("png", pixels.data(), size.width, size.height, 3, &png))
+        return;
+
+    std::vector<unsigned char> zlib = PngZlibStream(png);
+    const int inflated = (int)((size_t)size.width * 3 + 1) * size.height;
+    harness.Run(CaseName("zlib_inflate", nullptr, size), inflated, [&] {
+        int length = 0;
+        char* out = stbi_zlib_decode_malloc_guesssize((const char*)zlib.data(), (int)zlib.size(), inflated, &length);
+        KeepAlive(out);
+        free(out);
+    });
+
+    harness.Run(CaseName("png_decode", nullptr, size), pixels.size(), [&] {
+        int x, y, n;
+        stbi_uc* out = stbi_load_from_memory(png.data(), (int)png.size(), &x, &y, &n, 0);
+        KeepAlive(out);
+        free(out);
+    });
+
+    harness.Run(CaseName("png_decode", "rows", size), pixels.size(), [&] {
+        int x, y, n;
+        stbi_load_rows_from_memory(png.data(), (int)png.size(), &x, &y, &n, 0, KeepRows, nullptr);
+    });
+}
+
+static void JpegDecode(Harness& harness, const BenchSize& size) {
+    if (!AnyEnabled(harness, { CaseName("jpeg_decode", nullptr, size), CaseName("jpeg_decode", "scale2", size),
+                               CaseName("jpeg_decode", "scale4", size), CaseName("jpeg_decode", "scale8", size),
+                               CaseName("jpeg_decode", "crop256", size), CaseName("jpeg_decode", "rows", size) }))
+        return;
+    std::vector<unsigned char> pixels((size_t)size.width * size.height * 3);
+    FillPattern(pixels.data(), size.width, size.height, 3, 5);
+    std::vector<unsigned char> jpeg;
+    if (!EncodeImage("mjpeg", pixels.data(), size.width, size.height, 3, &jpeg))
+        return;
+
+    /* Huffman decoding, IDCT, upsampling and color conversion together */
+    harness.Run(CaseName("jpeg_decode", nullptr, size), pixels.size(), [&] {
+        int x, y, n;
+        stbi_uc* out = stbi_load_from_memory(jpeg.data(), (int)jpeg.size(), &x, &y, &n, 3);
+        KeepAlive(out);
+        free(out);
+    });
+
+    /* Reduced IDCTs straight to thumbnail size, bytes are still those of the full image */
+    static const int denominators[] = { 2, 4, 8 };
+    for (int denominator : denominators) {
+        char variant[16];
+        snprintf(variant, sizeof(variant), "scale%d", denominator);
+        stbi_set_jpeg_scale_on_load(denominator);
+        harness.Run(CaseName("jpeg_decode", variant, size), pixels.size(), [&] {
+            int x, y, n;
+            stbi_uc* out = stbi_load_from_memory(jpeg.data(), (int)jpeg.size(), &x, &y, &n, 3);
+            KeepAlive(out);
+            free(out);
+        });
+    }
+    stbi_set_jpeg_scale_on_load(1);
+
+    /* A 256x256 window out of the middle, Huffman decoding stops below it */
+    stbi_set_jpeg_crop_on_load(size.width / 2 - 128, size.height / 2 - 128, 256, 256);
+    harness.Run(CaseName("jpeg_decode", "crop256", size), 256 * 256 * 3, [&] {
+        int x, y, n;
+        stbi_uc* out = stbi_load_from_memory(jpeg.data(), (int)jpeg.size(), &x, &y, &n, 3);
+        KeepAlive(out);
+        free(out);
+    });
+    stbi_set_jpeg_crop_on_load(0, 0, 0, 0);
+
+    /* Streamed through a three MCU row window instead of whole planes */
+    harness.Run(CaseName("jpeg_decode", "rows", size), pixels.size(), [&] {
+        int x, y, n;
+        stbi_load_rows_from_memory(jpeg.data(), (int)jpeg.size(), &x, &y, &n, 3, KeepRows, nullptr);
+    });
+}
+
+static void YCbCrToRgb(Harness& harness, const BenchSize& size) {
+    std::vector<unsigned char> planes((size_t)size.width * size.height * 3);
+    FillPattern(planes.data(), size.width, size.height * 3, 1, 6);
+    const unsigned char* y = planes.data();
+    const unsigned char* cb = y + (size_t)size.width * size.height;
+    const unsigned char* cr = cb + (size_t)size.width * size.height;
+    std::vector<unsigned char> out((size_t)size.width * 4);
+
+    auto run = [&](const char* variant, void (*kernel)(stbi_uc*, const stbi_uc*, const stbi_uc*, const stbi_uc*, int, int)) {
+        harness.Run(CaseName("ycbcr_to_rgb", variant, size), (size_t)size.width * size.height * 3, [&] {
+            for (int row = 0; row < size.height; row++) {
+                size_t offset = (size_t)row * size.width;
+                kernel(out.data(), y + offset, cb + offset, cr + offset, size.width, 4);
+            }
+            KeepAlive(out.data());
+        });
+    };
+    run("scalar", stbi__YCbCr_to_RGB_row);
+#ifdef STBI_SSE2
+    if (stbi__sse2_available())
+        run("sse2", stbi__YCbCr_to_RGB_simd);
+#endif
+#ifdef STBI_NEON
+    run("neon", stbi__YCbCr_to_RGB_simd);
+#endif
+}
+
+static void Idct(Harness& harness) {
+    /* Coefficients shaped like dequantized photo blocks, energy falling off with frequency */
+    const int blocks = 1024;
+    std::vector<short> coefficients(blocks * 64);
+    uint32_t state = 12345;
+    for (int b = 0; b < blocks; b++) {
+        for (int i = 0; i < 64; i++) {
+            state = state * 1664525 + 1013904223;
+            int spread = 1024 >> ((i >> 3) + (i & 7));
+            coefficients[b * 64 + i] = spread ? (short)((int)(state >> 16) % (spread * 2 + 1) - spread) : 0;
+        }
+    }
+    std::vector<unsigned char> out(blocks * 64);
+
+    auto run = [&](const char* name, void (*kernel)(stbi_uc*, int, short*)) {
+        harness.Run(name, (uint64_t)blocks * 64, [&] {
+            for (int b = 0; b < blocks; b++)
+                kernel(&out[b * 64], 8, &coefficients[b * 64]);
+            KeepAlive(out.data());
+        });
+    };
+    run("stb/jpeg_idct/scalar/1024blocks", stbi__idct_block);
+#ifdef STBI_SSE2
+    if (stbi__sse2_available())
+        run("stb/jpeg_idct/sse2/1024blocks", stbi__idct_simd);
+#endif
+#ifdef STBI_NEON
+    run("stb/jpeg_idct/neon/1024blocks", stbi__idct_simd);
+#endif
+#ifdef STBI_AVX2
+    if (stbi__avx2_available()) {
+        harness.Run("stb/jpeg_idct/avx2_pair/1024blocks", (uint64_t)blocks * 64, [&] {
+            for (int b = 0; b < blocks; b += 2)
+                stbi__idct_avx2_pair(&out[b * 64], 16, &coefficients[b * 64]);
+            KeepAlive(out.data());
+        });
+    }
+#endif
+}
+
+static void HdrConversion(Harness& harness, const BenchSize& size) {
+    for (int channels : {3, 4}) {
+        const size_t count = (size_t)size.width * size.height * channels;
+        std::vector<unsigned char> ldr(count);
+        FillPattern(ldr.data(), size.width, size.height, channels, 7);
+        std::vector<float> hdr(count);
+        for (size_t i = 0; i < count; i++)
+            hdr[i] = ldr[i] / 64.0f;
+
+        char variant[8];
+        snprintf(variant, sizeof(variant), "c%d", channels);
+        unsigned char* ldrInput = nullptr;
+        float* hdrOutput = nullptr;
+        harness.RunWithSetup(CaseName("ldr_to_hdr", variant, size), count,
+            [&] {
+                free(hdrOutput);
+                hdrOutput = nullptr;
+                ldrInput = (unsigned char*)malloc(count);
+                memcpy(ldrInput, ldr.data(), count);
+            },
+            [&] { hdrOutput = stbi__ldr_to_hdr(ldrInput, size.width, size.height, channels); });
+        free(hdrOutput);
+
+        float* hdrInput = nullptr;
+        unsigned char* ldrOutput = nullptr;
+        harness.RunWithSetup(CaseName("hdr_to_ldr", variant, size), count * sizeof(float),
+            [&] {
+                free(ldrOutput);
+                ldrOutput = nullptr;
+                hdrInput = (float*)malloc(count * sizeof(float));
+                memcpy(hdrInput, hdr.data(), count * sizeof(float));
+            },
+            [&] { ldrOutput = stbi__hdr_to_ldr(hdrInput, size.width, size.height, channels); });
+        free(ldrOutput);
+    }
+}
+
+void RunStbBenchmarks(Harness& harness, const std::vector<BenchSize>& sizes) {
+    Idct(harness);
+    for (const BenchSize& size : sizes) {
+        ConvertFormat(harness, size);
+        VerticalFlip(harness, size);
+        YCbCrToRgb(harness, size);
+        PngUnfilter(harness, size);
+        PngAndZlib(harness, size);
+        JpegDecode(harness, size);
+        HdrConversion(harness, size);
+    }
+}
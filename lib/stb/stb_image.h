@@ -14,6 +14,17 @@
 
    You can #define STBI_ASSERT(x) before the #include to avoid using assert.h.
    And #define STBI_MALLOC, STBI_REALLOC, and STBI_FREE to avoid using malloc,realloc,free
+   And #define STBI_DECODE_BEGIN() and STBI_DECODE_END() to run code around every
+   image decode on the calling thread, e.g. profiling timers or counters.
+   And #define STBI_LOAD_ENTER(source,len) and STBI_LOAD_EXIT(result,w,h,comp) to
+   observe stbi_load_from_memory and stbi_load calls, e.g. as tracepoints. source
+   is the buffer or filename, len is -1 for files, w/h/comp are 0 on failure.
+   And #define STBI_PARALLEL_FOR(count,func,context) to let large JPEGs use
+   threads: it must call func(context,i) once for every i in [0,count), in
+   any order and on any threads, and return when all calls have finished.
+   Baseline JPEGs with restart intervals then decode their intervals through
+   it, and every large JPEG upsamples and color-converts in row bands. Without
+   it everything runs on the calling thread.
 
 
    QUICK NOTES:
@@ -267,6 +278,11 @@ RECENT REVISION HISTORY:
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// With GCC or Clang on x86, the JPEG IDCT also has an AVX2 kernel that
+// transforms two blocks at once. It is compiled with a function target
+// attribute and only used when the CPU reports AVX2, with bit-identical
+// output; define STBI_NO_AVX2 to leave it out.
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
@@ -430,6 +446,34 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
 #endif
 
+////////////////////////////////////
+//
+// streaming 8-bits-per-channel interface
+//
+// instead of returning one buffer, these hand the image to func in bands of
+// rows, top to bottom, as soon as they are decoded. pixels holds 'rows' rows
+// of x*n bytes starting at row y, n being desired_channels or else
+// channels_in_file, and is only valid during the call. x, y and
+// channels_in_file are filled in before the first call. they return 1 on
+// success and 0 on failure, which can come after some rows went out.
+//
+// baseline JPEGs keep three MCU rows of planes and non-interlaced PNGs a 32k
+// inflate window plus a few filtered rows, so memory doesn't grow with the
+// image; the compressed PNG data is still read in whole first. progressive
+// or multi-scan JPEGs are decoded whole and handed out in bands; interlaced
+// PNGs, other formats, and any load with vertical flipping on come out whole
+// in a single call
+
+typedef void stbi_rows_func(void *context, int y, int rows, stbi_uc const *pixels);
+
+STBIDEF int stbi_load_rows_from_memory   (stbi_uc           const *buffer, int len   , int *x, int *y, int *channels_in_file, int desired_channels, stbi_rows_func *func, void *context);
+STBIDEF int stbi_load_rows_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int *x, int *y, int *channels_in_file, int desired_channels, stbi_rows_func *func, void *context);
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_rows            (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, stbi_rows_func *func, void *context);
+STBIDEF int stbi_load_rows_from_file  (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels, stbi_rows_func *func, void *context);
+#endif
+
 #ifdef STBI_WINDOWS_UTF8
 STBIDEF int stbi_convert_wchar_to_utf8(char *buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -514,12 +558,30 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// decode JPEGs at 1/denominator of their size (1, 2, 4 or 8, other values
+// round down to one of those). each 8x8 block goes straight to 4x4, 2x2 or a
+// single pixel through a reduced IDCT of its low-frequency coefficients, so
+// the IDCT, upsampling and color conversion of the dropped pixels never run.
+// the loaded size is the full size divided by the denominator, rounded up;
+// stbi_info still reports the full size. other formats ignore this
+STBIDEF void stbi_set_jpeg_scale_on_load(int denominator);
+
+// decode only the w*h rectangle at x,y of JPEGs, given in full-size pixels
+// and clipped to the image; w or h <= 0 turns cropping off. only the MCUs
+// under it are reconstructed, upsampled and color-converted, and decoding
+// stops after the last MCU row it needs when nothing else is left to read
+// for it. combined with a scale, the result is the crop scaled down,
+// rounded outwards. loads fail if the rectangle misses the image
+STBIDEF void stbi_set_jpeg_crop_on_load(int x, int y, int w, int h);
+
 // as above, but only applies to images loaded on the thread that calls the function
 // this function is only available if your compiler supports thread-local variables;
 // calling it will fail to link if your compiler doesn't
 STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply);
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
+STBIDEF void stbi_set_jpeg_scale_on_load_thread(int denominator);
+STBIDEF void stbi_set_jpeg_crop_on_load_thread(int x, int y, int w, int h);
 
 // ZLIB client - used by PNG, available for other purposes
 
@@ -640,12 +702,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -657,16 +721,6 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
 #define STBI_NOTUSED(v)  (void)sizeof(v)
 #endif
 
-#ifdef _MSC_VER
-#define STBI_HAS_LROTL
-#endif
-
-#ifdef STBI_HAS_LROTL
-   #define stbi_lrot(x,y)  _lrotl(x,y)
-#else
-   #define stbi_lrot(x,y)  (((x) << (y)) | ((x) >> (-(y) & 31)))
-#endif
-
 #if defined(STBI_MALLOC) && defined(STBI_FREE) && (defined(STBI_REALLOC) || defined(STBI_REALLOC_SIZED))
 // ok
 #elif !defined(STBI_MALLOC) && !defined(STBI_FREE) && !defined(STBI_REALLOC) && !defined(STBI_REALLOC_SIZED)
@@ -768,6 +822,20 @@ static int stbi__sse2_available(void)
 }
 #endif
 
+// AVX2 is only used from functions compiled with a target attribute and
+// picked at runtime, so the rest of the file stays plain SSE2. Define
+// STBI_NO_AVX2 to leave it out.
+#if !defined(STBI_NO_JPEG) && !defined(STBI_NO_AVX2) && (defined(__clang__) || __GNUC__ >= 5)
+#define STBI_AVX2
+#include <immintrin.h>
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+
+static int stbi__avx2_available(void)
+{
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+
 #endif
 #endif
 
@@ -902,15 +970,26 @@ typedef struct
    int channel_order;
 } stbi__result_info;
 
+// where a streaming load sends its rows
+typedef struct
+{
+   stbi_rows_func *func;
+   void *context;
+   int *x, *y, *comp;
+   int req_comp;
+} stbi__rows;
+
 #ifndef STBI_NO_JPEG
 static int      stbi__jpeg_test(stbi__context *s);
 static void    *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
+static int      stbi__jpeg_load_rows(stbi__context *s, stbi__rows *rows);
 static int      stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
 #ifndef STBI_NO_PNG
 static int      stbi__png_test(stbi__context *s);
 static void    *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
+static int      stbi__png_load_rows(stbi__context *s, stbi__rows *rows);
 static int      stbi__png_info(stbi__context *s, int *x, int *y, int *comp);
 static int      stbi__png_is16(stbi__context *s);
 #endif
@@ -1114,7 +1193,81 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
-static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
+// log2 of the jpeg downscale factor
+static int stbi__jpeg_scale_global = 0;
+
+static int stbi__jpeg_scale_shift(int denominator)
+{
+   int shift = 0;
+   while (shift < 3 && (2 << shift) <= denominator) ++shift;
+   return shift;
+}
+
+STBIDEF void stbi_set_jpeg_scale_on_load(int denominator)
+{
+   stbi__jpeg_scale_global = stbi__jpeg_scale_shift(denominator);
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_scale  stbi__jpeg_scale_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_scale_local, stbi__jpeg_scale_set;
+
+STBIDEF void stbi_set_jpeg_scale_on_load_thread(int denominator)
+{
+   stbi__jpeg_scale_local = stbi__jpeg_scale_shift(denominator);
+   stbi__jpeg_scale_set = 1;
+}
+
+#define stbi__jpeg_scale  (stbi__jpeg_scale_set           \
+                            ? stbi__jpeg_scale_local      \
+                            : stbi__jpeg_scale_global)
+#endif // STBI_THREAD_LOCAL
+
+// jpeg crop as x, y, w, h
+static int stbi__jpeg_crop_global[4];
+
+STBIDEF void stbi_set_jpeg_crop_on_load(int x, int y, int w, int h)
+{
+   stbi__jpeg_crop_global[0] = x;
+   stbi__jpeg_crop_global[1] = y;
+   stbi__jpeg_crop_global[2] = w;
+   stbi__jpeg_crop_global[3] = h;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_crop  stbi__jpeg_crop_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_crop_local[4], stbi__jpeg_crop_set;
+
+STBIDEF void stbi_set_jpeg_crop_on_load_thread(int x, int y, int w, int h)
+{
+   stbi__jpeg_crop_local[0] = x;
+   stbi__jpeg_crop_local[1] = y;
+   stbi__jpeg_crop_local[2] = w;
+   stbi__jpeg_crop_local[3] = h;
+   stbi__jpeg_crop_set = 1;
+}
+
+#define stbi__jpeg_crop  (stbi__jpeg_crop_set            \
+                           ? stbi__jpeg_crop_local       \
+                           : stbi__jpeg_crop_global)
+#endif // STBI_THREAD_LOCAL
+
+#ifndef STBI_DECODE_BEGIN
+#define STBI_DECODE_BEGIN()
+#endif
+#ifndef STBI_DECODE_END
+#define STBI_DECODE_END()
+#endif
+#ifndef STBI_LOAD_ENTER
+#define STBI_LOAD_ENTER(source,len)
+#endif
+#ifndef STBI_LOAD_EXIT
+#define STBI_LOAD_EXIT(result,w,h,comp)
+#endif
+
+static void *stbi__load_dispatch(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
    ri->bits_per_channel = 8; // default is 8 so most paths don't have to be changed
@@ -1167,6 +1320,15 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    return stbi__errpuc("unknown image type", "Image not of any known type, or corrupt");
 }
 
+static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
+{
+   void *result;
+   STBI_DECODE_BEGIN();
+   result = stbi__load_dispatch(s, x, y, comp, req_comp, ri, bpc);
+   STBI_DECODE_END();
+   return result;
+}
+
 static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int channels)
 {
    int i;
@@ -1300,6 +1462,49 @@ static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, in
 }
 #endif
 
+// fill in the size and components before the first rows go out
+static void stbi__rows_begin(stbi__rows *r, int w, int h, int comp)
+{
+   *r->x = w;
+   *r->y = h;
+   if (r->comp) *r->comp = comp;
+}
+
+static int stbi__load_rows_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi_rows_func *func, void *context)
+{
+   stbi_uc *data;
+   int n, ok = -1;
+   stbi__rows r;
+   if (req_comp < 0 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   r.func = func;
+   r.context = context;
+   r.x = x;
+   r.y = y;
+   r.comp = comp;
+   r.req_comp = req_comp;
+
+   // flipped images end with their first row, so they can't stream
+   if (!stbi__vertically_flip_on_load) {
+      STBI_DECODE_BEGIN();
+      #ifndef STBI_NO_PNG
+      if (stbi__png_test(s))  ok = stbi__png_load_rows(s, &r);
+      #endif
+      #ifndef STBI_NO_JPEG
+      if (ok < 0 && stbi__jpeg_test(s)) ok = stbi__jpeg_load_rows(s, &r);
+      #endif
+      STBI_DECODE_END();
+      if (ok >= 0) return ok;
+   }
+
+   // everything else is decoded whole and handed over in one go
+   data = stbi__load_and_postprocess_8bit(s, x, y, &n, req_comp);
+   if (!data) return 0;
+   if (comp) *comp = n;
+   func(context, 0, *y, data);
+   STBI_FREE(data);
+   return 1;
+}
+
 #ifndef STBI_NO_STDIO
 
 #if defined(_WIN32) && defined(STBI_WINDOWS_UTF8)
@@ -1345,11 +1550,17 @@ static FILE *stbi__fopen(char const *filename, char const *mode)
 
 STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
+   FILE *f;
    unsigned char *result;
-   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   STBI_LOAD_ENTER(filename, -1);
+   f = stbi__fopen(filename, "rb");
+   if (!f) {
+      STBI_LOAD_EXIT(NULL, 0, 0, 0);
+      return stbi__errpuc("can't fopen", "Unable to open file");
+   }
    result = stbi_load_from_file(f,x,y,comp,req_comp);
    fclose(f);
+   STBI_LOAD_EXIT(result, result ? *x : 0, result ? *y : 0, result && comp ? *comp : 0);
    return result;
 }
 
@@ -1366,6 +1577,29 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req
    return result;
 }
 
+STBIDEF int stbi_load_rows(char const *filename, int *x, int *y, int *comp, int req_comp, stbi_rows_func *func, void *context)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   int result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   result = stbi_load_rows_from_file(f,x,y,comp,req_comp,func,context);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_rows_from_file(FILE *f, int *x, int *y, int *comp, int req_comp, stbi_rows_func *func, void *context)
+{
+   int result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   result = stbi__load_rows_main(&s,x,y,comp,req_comp,func,context);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
+
 STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
    stbi__uint16 *result;
@@ -1409,8 +1643,12 @@ STBIDEF stbi_us *stbi_load_16_from_callbacks(stbi_io_callbacks const *clbk, void
 STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
 {
    stbi__context s;
+   stbi_uc *result;
+   STBI_LOAD_ENTER(buffer, len);
    stbi__start_mem(&s,buffer,len);
-   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   STBI_LOAD_EXIT(result, result ? *x : 0, result ? *y : 0, result && comp ? *comp : 0);
+   return result;
 }
 
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
@@ -1420,6 +1658,20 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_rows_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_rows_func *func, void *context)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_rows_main(&s,x,y,comp,req_comp,func,context);
+}
+
+STBIDEF int stbi_load_rows_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp, stbi_rows_func *func, void *context)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_rows_main(&s,x,y,comp,req_comp,func,context);
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1443,7 +1695,10 @@ static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int
    #ifndef STBI_NO_HDR
    if (stbi__hdr_test(s)) {
       stbi__result_info ri;
-      float *hdr_data = stbi__hdr_load(s,x,y,comp,req_comp, &ri);
+      float *hdr_data;
+      STBI_DECODE_BEGIN();
+      hdr_data = stbi__hdr_load(s,x,y,comp,req_comp, &ri);
+      STBI_DECODE_END();
       if (hdr_data)
          stbi__float_postprocess(hdr_data,x,y,comp,req_comp);
       return hdr_data;
@@ -1913,7 +2168,7 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 #ifndef STBI_NO_JPEG
 
 // huffman decoding acceleration
-#define FAST_BITS   9  // larger handles more cases; smaller stomps less cache
+#define FAST_BITS   10 // larger handles more cases; smaller stomps less cache
 
 typedef struct
 {
@@ -1932,12 +2187,21 @@ typedef struct
    stbi__huffman huff_dc[4];
    stbi__huffman huff_ac[4];
    stbi__uint16 dequant[4][64];
-   stbi__int16 fast_ac[4][1 << FAST_BITS];
+   stbi__int32 fast_dc[4][1 << FAST_BITS];
+   stbi__int32 fast_ac[4][1 << FAST_BITS];
 
 // sizes for components, interleaved MCUs
    int img_h_max, img_v_max;
    int img_mcu_x, img_mcu_y;
    int img_mcu_w, img_mcu_h;
+   int scale; // log2 of the downscale of the output image
+   int crop_x0, crop_y0, crop_x1, crop_y1; // crop in full-size pixels, empty for none
+   int win_x0, win_y0, win_x1, win_y1;     // MCUs that get reconstructed
+   stbi__uint32 out_x0, out_y0, out_w, out_h; // crop in output pixels
+   int done_early; // the scan stopped below the window, skip the rest of the file
+   stbi__rows *rows;  // streaming load: where finished rows go, NULL otherwise
+   int win_y1_full;   // bottom of the window; win_y1 is less while streaming
+   int streamed;      // every row went out while decoding
 
 // definition of jpeg image component
    struct
@@ -1954,9 +2218,12 @@ typedef struct
       stbi_uc *linebuf;
       short   *coeff;   // progressive only
       int      coeff_w, coeff_h; // number of 8x8 coefficient blocks
+      int      scale;   // log2 of this plane's downscale, at most the image's
+      void   (*idct_kernel)(stbi_uc *out, int out_stride, short data[64]);
+      void   (*idct_pair_kernel)(stbi_uc *out, int out_stride, short data[128]);
    } img_comp[4];
 
-   stbi__uint32   code_buffer; // jpeg entropy-coded buffer
+   stbi__uint64   code_buffer; // jpeg entropy-coded buffer, valid bits at the top
    int            code_bits;   // number of valid bits
    unsigned char  marker;      // marker seen while filling entropy buffer
    int            nomore;      // flag if we saw a marker so must stop
@@ -1976,6 +2243,8 @@ typedef struct
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
+   // two horizontally adjacent blocks, data[64..127] lands at out+8; NULL if unavailable
+   void (*idct_pair_kernel)(stbi_uc *out, int out_stride, short data[128]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
@@ -2022,11 +2291,20 @@ static int stbi__build_huffman(stbi__huffman *h, int *count)
    return 1;
 }
 
-// build a table that decodes both magnitude and value of small ACs in
-// one go.
-static void stbi__build_fast_ac(stbi__int16 *fast_ac, stbi__huffman *h)
+// build a table that decodes both magnitude and value of small DCs or ACs
+// in one go. an entry holds the value in its top 16 bits, the run in bits
+// 4-7 and the combined length in bits 0-3, or is 0 if the code doesn't fit.
+// in AC tables, bits 8-11 give the length of an end-of-block code that
+// directly follows, so a block's last coefficient and its end take one lookup
+static void stbi__build_fast_ac(stbi__int32 *fast_ac, stbi__huffman *h, int dc)
 {
-   int i;
+   int i, eob_len = 0, eob_code = 0;
+   for (i=0; !dc && h->size[i]; ++i) {
+      if (h->values[i] == 0) {
+         eob_len = h->size[i];
+         eob_code = h->code[i];
+      }
+   }
    for (i=0; i < (1 << FAST_BITS); ++i) {
       stbi_uc fast = h->fast[i];
       fast_ac[i] = 0;
@@ -2036,14 +2314,15 @@ static void stbi__build_fast_ac(stbi__int16 *fast_ac, stbi__huffman *h)
          int magbits = rs & 15;
          int len = h->size[fast];
 
-         if (magbits && len + magbits <= FAST_BITS) {
+         // a DC of 0 has no magnitude bits, an AC without them is EOB or ZRL
+         if ((dc ? rs < 16 : magbits != 0) && len + magbits <= FAST_BITS) {
             // magnitude code followed by receive_extend code
             int k = ((i << len) & ((1 << FAST_BITS) - 1)) >> (FAST_BITS - magbits);
-            int m = 1 << (magbits - 1);
-            if (k < m) k += (~0U << magbits) + 1;
-            // if the result is small enough, we can fit it in fast_ac table
-            if (k >= -128 && k <= 127)
-               fast_ac[i] = (stbi__int16) ((k * 256) + (run * 16) + (len + magbits));
+            if (magbits && k < (1 << (magbits - 1))) k += (~0U << magbits) + 1;
+            fast_ac[i] = (k * 65536) + (run * 16) + (len + magbits);
+            len += magbits;
+            if (eob_len && len + eob_len <= FAST_BITS && ((i << len) & ((1 << FAST_BITS) - 1)) >> (FAST_BITS - eob_len) == eob_code)
+               fast_ac[i] += eob_len << 8;
          }
       }
    }
@@ -2051,6 +2330,20 @@ static void stbi__build_fast_ac(stbi__int16 *fast_ac, stbi__huffman *h)
 
 static void stbi__grow_buffer_unsafe(stbi__jpeg *j)
 {
+   // away from markers, take every whole byte that fits in one load
+   if (!j->nomore && j->code_bits >= 0 && j->s->img_buffer_end - j->s->img_buffer >= 8) {
+      stbi_uc *p = j->s->img_buffer;
+      stbi__uint64 v = ((stbi__uint64) p[0] << 56) | ((stbi__uint64) p[1] << 48) | ((stbi__uint64) p[2] << 40) | ((stbi__uint64) p[3] << 32)
+                     | ((stbi__uint64) p[4] << 24) | ((stbi__uint64) p[5] << 16) | ((stbi__uint64) p[6] <<  8) |  (stbi__uint64) p[7];
+      // any 0xff byte could start a marker or be stuffed, those go one at a time
+      if (!((~v - 0x0101010101010101ull) & v & 0x8080808080808080ull)) {
+         int n = (64 - j->code_bits) >> 3;
+         j->code_buffer |= (v & (~(stbi__uint64) 0 << (64 - 8*n))) >> j->code_bits;
+         j->code_bits += 8*n;
+         j->s->img_buffer += n;
+         return;
+      }
+   }
    do {
       unsigned int b = j->nomore ? 0 : stbi__get8(j->s);
       if (b == 0xff) {
@@ -2062,14 +2355,11 @@ static void stbi__grow_buffer_unsafe(stbi__jpeg *j)
             return;
          }
       }
-      j->code_buffer |= b << (24 - j->code_bits);
+      j->code_buffer |= (stbi__uint64) b << (56 - j->code_bits);
       j->code_bits += 8;
-   } while (j->code_bits <= 24);
+   } while (j->code_bits <= 56);
 }
 
-// (1 << n) - 1
-static const stbi__uint32 stbi__bmask[17]={0,1,3,7,15,31,63,127,255,511,1023,2047,4095,8191,16383,32767,65535};
-
 // decode a jpeg huffman value from the bitstream
 stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
 {
@@ -2080,7 +2370,7 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
 
    // look at the top FAST_BITS and determine what symbol ID it is,
    // if the code is <= FAST_BITS
-   c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
+   c = (int) (j->code_buffer >> (64 - FAST_BITS));
    k = h->fast[c];
    if (k < 255) {
       int s = h->size[k];
@@ -2097,7 +2387,7 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
    // end; in other words, regardless of the number of bits, it
    // wants to be compared against something shifted to have 16;
    // that way we don't need to shift inside the loop.
-   temp = j->code_buffer >> 16;
+   temp = (unsigned int) (j->code_buffer >> 48);
    for (k=FAST_BITS+1 ; ; ++k)
       if (temp < h->maxcode[k])
          break;
@@ -2111,8 +2401,8 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
       return -1;
 
    // convert the huffman code to the symbol id
-   c = ((j->code_buffer >> (32 - k)) & stbi__bmask[k]) + h->delta[k];
-   STBI_ASSERT((((j->code_buffer) >> (32 - h->size[c])) & stbi__bmask[h->size[c]]) == h->code[c]);
+   c = (int) (j->code_buffer >> (64 - k)) + h->delta[k];
+   STBI_ASSERT((j->code_buffer >> (64 - h->size[c])) == h->code[c]);
 
    // convert the id to a symbol
    j->code_bits -= k;
@@ -2131,10 +2421,9 @@ stbi_inline static int stbi__extend_receive(stbi__jpeg *j, int n)
    int sgn;
    if (j->code_bits < n) stbi__grow_buffer_unsafe(j);
 
-   sgn = j->code_buffer >> 31; // sign bit always in MSB; 0 if MSB clear (positive), 1 if MSB set (negative)
-   k = stbi_lrot(j->code_buffer, n);
-   j->code_buffer = k & ~stbi__bmask[n];
-   k &= stbi__bmask[n];
+   sgn = (int) (j->code_buffer >> 63); // sign bit always in MSB; 0 if MSB clear (positive), 1 if MSB set (negative)
+   k = (unsigned int) (j->code_buffer >> (64 - n));
+   j->code_buffer <<= n;
    j->code_bits -= n;
    return k + (stbi__jbias[n] & (sgn - 1));
 }
@@ -2144,21 +2433,20 @@ stbi_inline static int stbi__jpeg_get_bits(stbi__jpeg *j, int n)
 {
    unsigned int k;
    if (j->code_bits < n) stbi__grow_buffer_unsafe(j);
-   k = stbi_lrot(j->code_buffer, n);
-   j->code_buffer = k & ~stbi__bmask[n];
-   k &= stbi__bmask[n];
+   k = (unsigned int) (j->code_buffer >> (64 - n));
+   j->code_buffer <<= n;
    j->code_bits -= n;
    return k;
 }
 
 stbi_inline static int stbi__jpeg_get_bit(stbi__jpeg *j)
 {
-   unsigned int k;
+   int k;
    if (j->code_bits < 1) stbi__grow_buffer_unsafe(j);
-   k = j->code_buffer;
+   k = (int) (j->code_buffer >> 63);
    j->code_buffer <<= 1;
    --j->code_bits;
-   return k & 0x80000000;
+   return k;
 }
 
 // given a value that's at position X in the zigzag stream,
@@ -2179,19 +2467,26 @@ static const stbi_uc stbi__jpeg_dezigzag[64+15] =
 };
 
 // decode one 64-entry block--
-static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman *hdc, stbi__huffman *hac, stbi__int16 *fac, int b, stbi__uint16 *dequant)
+static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman *hdc, stbi__huffman *hac, stbi__int32 *fdc, stbi__int32 *fac, int b, stbi__uint16 *dequant)
 {
    int diff,dc,k;
    int t;
 
    if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
-   t = stbi__jpeg_huff_decode(j, hdc);
-   if (t < 0 || t > 15) return stbi__err("bad huffman code","Corrupt JPEG");
+   t = fdc[j->code_buffer >> (64 - FAST_BITS)];
+   if (t) { // fast-DC path
+      j->code_buffer <<= t & 15;
+      j->code_bits -= t & 15;
+      diff = t >> 16;
+   } else {
+      t = stbi__jpeg_huff_decode(j, hdc);
+      if (t < 0 || t > 15) return stbi__err("bad huffman code","Corrupt JPEG");
+      diff = t ? stbi__extend_receive(j, t) : 0;
+   }
 
    // 0 all the ac values now so we can do it 32-bits at a time
    memset(data,0,64*sizeof(data[0]));
 
-   diff = t ? stbi__extend_receive(j, t) : 0;
    dc = j->img_comp[b].dc_pred + diff;
    j->img_comp[b].dc_pred = dc;
    data[0] = (short) (dc * dequant[0]);
@@ -2202,7 +2497,7 @@ static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman
       unsigned int zig;
       int c,r,s;
       if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
-      c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
+      c = (int) (j->code_buffer >> (64 - FAST_BITS));
       r = fac[c];
       if (r) { // fast-AC path
          k += (r >> 4) & 15; // run
@@ -2211,7 +2506,14 @@ static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman
          j->code_bits -= s;
          // decode into unzigzag'd location
          zig = stbi__jpeg_dezigzag[k++];
-         data[zig] = (short) ((r >> 8) * dequant[zig]);
+         data[zig] = (short) ((r >> 16) * dequant[zig]);
+         // the end of block came with it, unless the block is already full
+         if ((r & 0xf00) && k < 64) {
+            s = (r >> 8) & 15;
+            j->code_buffer <<= s;
+            j->code_bits -= s;
+            break;
+         }
       } else {
          int rs = stbi__jpeg_huff_decode(j, hac);
          if (rs < 0) return stbi__err("bad huffman code","Corrupt JPEG");
@@ -2259,7 +2561,7 @@ static int stbi__jpeg_decode_block_prog_dc(stbi__jpeg *j, short data[64], stbi__
 
 // @OPTIMIZE: store non-zigzagged during the decode passes,
 // and only de-zigzag when dequantizing
-static int stbi__jpeg_decode_block_prog_ac(stbi__jpeg *j, short data[64], stbi__huffman *hac, stbi__int16 *fac)
+static int stbi__jpeg_decode_block_prog_ac(stbi__jpeg *j, short data[64], stbi__huffman *hac, stbi__int32 *fac)
 {
    int k;
    if (j->spec_start == 0) return stbi__err("can't merge dc and ac", "Corrupt JPEG");
@@ -2277,7 +2579,7 @@ static int stbi__jpeg_decode_block_prog_ac(stbi__jpeg *j, short data[64], stbi__
          unsigned int zig;
          int c,r,s;
          if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
-         c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
+         c = (int) (j->code_buffer >> (64 - FAST_BITS));
          r = fac[c];
          if (r) { // fast-AC path
             k += (r >> 4) & 15; // run
@@ -2285,7 +2587,14 @@ static int stbi__jpeg_decode_block_prog_ac(stbi__jpeg *j, short data[64], stbi__
             j->code_buffer <<= s;
             j->code_bits -= s;
             zig = stbi__jpeg_dezigzag[k++];
-            data[zig] = (short) ((r >> 8) * (1 << shift));
+            data[zig] = (short) ((r >> 16) * (1 << shift));
+            // an end of band right after it is an eob run of one, this block
+            if ((r & 0xf00) && k <= j->spec_end) {
+               s = (r >> 8) & 15;
+               j->code_buffer <<= s;
+               j->code_bits -= s;
+               break;
+            }
          } else {
             int rs = stbi__jpeg_huff_decode(j, hac);
             if (rs < 0) return stbi__err("bad huffman code","Corrupt JPEG");
@@ -2489,6 +2798,58 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced IDCTs for scaled decoding: an N-point IDCT over the N lowest
+// frequencies samples the same signal at the centers of NxN pixel groups.
+// columns keep 2 extra bits like the full IDCT, and with the 1/4 that the
+// 2D normalization leaves over, 1<<16 comes off at the end
+static void stbi__idct_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   int i, v[16];
+   for (i=0; i < 4; ++i) {
+      short *d = data + i;
+      int e0 = (d[0] + d[16]) * stbi__f2f(0.707106781f);
+      int e1 = (d[0] - d[16]) * stbi__f2f(0.707106781f);
+      int o0 = d[8]*stbi__f2f(0.923879533f) + d[24]*stbi__f2f(0.382683432f);
+      int o1 = d[8]*stbi__f2f(0.382683432f) - d[24]*stbi__f2f(0.923879533f);
+      v[i   ] = (e0 + o0 + 512) >> 10;
+      v[i+ 4] = (e1 + o1 + 512) >> 10;
+      v[i+ 8] = (e1 - o1 + 512) >> 10;
+      v[i+12] = (e0 - o0 + 512) >> 10;
+   }
+   for (i=0; i < 4; ++i, out += out_stride) {
+      int *r = v + i*4;
+      int e0 = (r[0] + r[2]) * stbi__f2f(0.707106781f) + (1 << 15) + (128 << 16);
+      int e1 = (r[0] - r[2]) * stbi__f2f(0.707106781f) + (1 << 15) + (128 << 16);
+      int o0 = r[1]*stbi__f2f(0.923879533f) + r[3]*stbi__f2f(0.382683432f);
+      int o1 = r[1]*stbi__f2f(0.382683432f) - r[3]*stbi__f2f(0.923879533f);
+      out[0] = stbi__clamp((e0 + o0) >> 16);
+      out[1] = stbi__clamp((e1 + o1) >> 16);
+      out[2] = stbi__clamp((e1 - o1) >> 16);
+      out[3] = stbi__clamp((e0 - o0) >> 16);
+   }
+}
+
+static void stbi__idct_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   int v0 = ((data[0] + data[8]) * stbi__f2f(0.707106781f) + 512) >> 10;
+   int v1 = ((data[1] + data[9]) * stbi__f2f(0.707106781f) + 512) >> 10;
+   int v2 = ((data[0] - data[8]) * stbi__f2f(0.707106781f) + 512) >> 10;
+   int v3 = ((data[1] - data[9]) * stbi__f2f(0.707106781f) + 512) >> 10;
+   int bias = (1 << 15) + (128 << 16);
+   out[0] = stbi__clamp(((v0 + v1) * stbi__f2f(0.707106781f) + bias) >> 16);
+   out[1] = stbi__clamp(((v0 - v1) * stbi__f2f(0.707106781f) + bias) >> 16);
+   out += out_stride;
+   out[0] = stbi__clamp(((v2 + v3) * stbi__f2f(0.707106781f) + bias) >> 16);
+   out[1] = stbi__clamp(((v2 - v3) * stbi__f2f(0.707106781f) + bias) >> 16);
+}
+
+// the DC term alone, which is what the full IDCT gives a flat block
+static void stbi__idct_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2670,6 +3031,182 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 integer IDCT of two blocks at once, one per 128-bit lane. Every
+// step is the sse2 kernel's, and all the shuffles it uses stay within a
+// lane, so each lane reproduces stbi__idct_simd (and thus the generic C
+// version) bit for bit.
+static STBI__AVX2_TARGET void stbi__idct_avx2_pair(stbi_uc *out, int out_stride, short data[128])
+{
+   __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m256i tmp;
+
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+   #define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+   #define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+   #define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   // row r of the first block in the low lane, of the second in the high lane
+   #define dct_load(r) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (data + (r)*8))), \
+                              _mm_loadu_si128((const __m128i *) (data + 64 + (r)*8)), 1)
+
+   // lanes hold rows r,r+1 of each block; regroup to [a_r b_r | a_r+1 b_r+1] and store both
+   #define dct_store2(p) \
+      { \
+         __m256i rows = _mm256_permute4x64_epi64(p, 0xd8); \
+         _mm_storeu_si128((__m128i *) out, _mm256_castsi256_si128(rows)); out += out_stride; \
+         _mm_storeu_si128((__m128i *) out, _mm256_extracti128_si256(rows, 1)); out += out_stride; \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   row0 = dct_load(0);
+   row1 = dct_load(1);
+   row2 = dct_load(2);
+   row3 = dct_load(3);
+   row4 = dct_load(4);
+   row5 = dct_load(5);
+   row6 = dct_load(6);
+   row7 = dct_load(7);
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose, per lane
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      __m256i p0 = _mm256_packus_epi16(row0, row1);
+      __m256i p1 = _mm256_packus_epi16(row2, row3);
+      __m256i p2 = _mm256_packus_epi16(row4, row5);
+      __m256i p3 = _mm256_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose, per lane
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      // p0 holds output rows 0,1, then p2 rows 2,3, p1 rows 4,5, p3 rows 6,7
+      dct_store2(p0);
+      dct_store2(p2);
+      dct_store2(p1);
+      dct_store2(p3);
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#undef dct_store2
+}
+
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2912,67 +3449,333 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+// decode and reconstruct the baseline mcus [first, first+count) of the current
+// scan, following restart markers as they come. in single-component scans
+// every block is an mcu, in scanline order over the component's own blocks
+// where block i,j of a plane is reconstructed, or NULL when it is outside
+// the window. windows cover whole MCUs, so blocks of one MCU are all in or out
+stbi_inline static stbi_uc *stbi__jpeg_block_out(stbi__jpeg *z, int n, int i, int j)
 {
-   stbi__jpeg_reset(z);
-   if (!z->progressive) {
-      if (z->scan_n == 1) {
-         int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
-         int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  // if it's NOT a restart, then just bail, so we get corrupt data
-                  // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
+   int bs = 8 >> z->img_comp[n].scale;
+   i -= z->win_x0 * z->img_comp[n].h;
+   j -= z->win_y0 * z->img_comp[n].v;
+   if (i < 0 || j < 0 || i >= (z->win_x1 - z->win_x0) * z->img_comp[n].h || j >= (z->win_y1 - z->win_y0) * z->img_comp[n].v)
+      return NULL;
+   return z->img_comp[n].data + z->img_comp[n].w2*j*bs + i*bs;
+}
+
+static int stbi__jpeg_decode_baseline_mcus(stbi__jpeg *z, int first, int count)
+{
+   STBI_SIMD_ALIGN(short, data[128]);
+   int m, end = first + count;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      int ha = z->img_comp[n].ha;
+      // non-interleaved data, we just need to process one block at a time,
+      // in trivial scanline order
+      // number of blocks to do just depends on how many actual "pixels" this
+      // component has, independent of interleaved MCU blocking and such
+      int w = (z->img_comp[n].x+7) >> 3;
+      // with a pair kernel, a block waits in data[0..63] for its right neighbour
+      int held = 0;
+      for (m=first; m < end; ++m) {
+         int i = m % w, j = m / w;
+         stbi_uc *out = stbi__jpeg_block_out(z, n, i, j);
+         if (!stbi__jpeg_decode_block(z, data + 64*held, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_dc[z->img_comp[n].hd], z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         if (held) {
+            z->img_comp[n].idct_pair_kernel(out-8, z->img_comp[n].w2, data);
+            held = 0;
+         } else if (z->img_comp[n].idct_pair_kernel && i+1 < w && m+1 < end && out && stbi__jpeg_block_out(z, n, i+1, j)) {
+            held = 1;
+         } else if (out) {
+            z->img_comp[n].idct_kernel(out, z->img_comp[n].w2, data);
+         }
+         // every data block is an MCU, so countdown the restart interval
+         if (--z->todo <= 0) {
+            if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+            // if it's NOT a restart, then just bail, so we get corrupt data
+            // rather than no data
+            if (!STBI__RESTART(z->marker)) {
+               if (held) z->img_comp[n].idct_kernel(out, z->img_comp[n].w2, data);
+               return 1;
             }
+            stbi__jpeg_reset(z);
          }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
-                     }
-                  }
-               }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
+      }
+   } else { // interleaved
+      int k,x,y;
+      for (m=first; m < end; ++m) {
+         int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+         // scan an interleaved mcu... process scan_n components in order
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            // scan out an mcu's worth of this component; that's just determined
+            // by the basic H and V specified for the component
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int ha = z->img_comp[n].ha;
+                  // blocks side by side within the mcu go through the pair kernel together
+                  short *block = z->img_comp[n].idct_pair_kernel ? data + 64*(x & 1) : data;
+                  stbi_uc *out = stbi__jpeg_block_out(z, n, i*z->img_comp[n].h + x, j*z->img_comp[n].v + y);
+                  if (!stbi__jpeg_decode_block(z, block, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_dc[z->img_comp[n].hd], z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  if (!out)
+                     continue;
+                  if (block != data)
+                     z->img_comp[n].idct_pair_kernel(out-8, z->img_comp[n].w2, data);
+                  else if (!z->img_comp[n].idct_pair_kernel || x+1 == z->img_comp[n].h)
+                     z->img_comp[n].idct_kernel(out, z->img_comp[n].w2, data);
                }
             }
          }
-         return 1;
+         // after all interleaved components, that's an interleaved MCU,
+         // so now count down the restart interval
+         if (--z->todo <= 0) {
+            if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+            if (!STBI__RESTART(z->marker)) return 1;
+            stbi__jpeg_reset(z);
+         }
+      }
+   }
+   return 1;
+}
+
+static int stbi__jpeg_baseline_mcu_count(stbi__jpeg *z)
+{
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      return ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   }
+   return z->img_mcu_x * z->img_mcu_y;
+}
+
+// how many MCUs of the current baseline scan it takes to cover every row of
+// the window
+static int stbi__jpeg_baseline_mcu_needed(stbi__jpeg *z)
+{
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      int h = (z->img_comp[n].y+7) >> 3, rows = z->win_y1 * z->img_comp[n].v;
+      return ((z->img_comp[n].x+7) >> 3) * (rows < h ? rows : h);
+   }
+   return z->img_mcu_x * z->win_y1;
+}
+
+#ifdef STBI_PARALLEL_FOR
+// smaller images aren't worth the hand-off to other threads
+#ifndef STBI_PARALLEL_MIN_PIXELS
+#define STBI_PARALLEL_MIN_PIXELS (1 << 18)
+#endif
+
+// most work items handed to STBI_PARALLEL_FOR for one scan, each takes a
+// run of consecutive restart intervals and its own copy of the decoder
+#define STBI__PARALLEL_MAX_ITEMS 64
+
+// whether any of MCUs [first, first+count) of the current baseline scan are
+// in the window; runs that wrap onto another row are assumed to be
+static int stbi__jpeg_window_hit(stbi__jpeg *z, int first, int count)
+{
+   int w = z->img_mcu_x, x0 = z->win_x0, x1 = z->win_x1, y0 = z->win_y0, y1 = z->win_y1;
+   int last = first + count - 1;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      w = (z->img_comp[n].x+7) >> 3;
+      x0 *= z->img_comp[n].h; x1 *= z->img_comp[n].h;
+      y0 *= z->img_comp[n].v; y1 *= z->img_comp[n].v;
+   }
+   if (last / w < y0 || first / w >= y1) return 0;
+   if (first / w != last / w) return 1;
+   return last % w >= x0 && first % w < x1;
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   const stbi_uc *scan;    // entropy-coded data up to and including the marker ending it
+   int *segment;           // offset of each restart interval in scan, plus the end
+   int intervals;
+   int items;
+   int mcus;
+   int *failed;            // one flag per item
+} stbi__jpeg_intervals;
+
+static void stbi__jpeg_decode_interval_item(void *context, int item)
+{
+   stbi__jpeg_intervals *p = (stbi__jpeg_intervals *) context;
+   int first = (int) ((size_t) p->intervals * item / p->items);
+   int last = (int) ((size_t) p->intervals * (item+1) / p->items);
+   stbi__context s;
+   int k;
+   stbi__jpeg *z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (!z) {
+      p->failed[item] = 1;
+      return;
+   }
+   memcpy(z, p->z, sizeof(*z));
+   z->s = &s;
+   for (k=first; k < last; ++k) {
+      // each segment ends with the RSTn marker that the serial decoder would have seen
+      int start = k * z->restart_interval;
+      int count = p->mcus - start < z->restart_interval ? p->mcus - start : z->restart_interval;
+      if (!stbi__jpeg_window_hit(z, start, count)) continue;
+      stbi__start_mem(&s, p->scan + p->segment[k], p->segment[k+1] - p->segment[k]);
+      stbi__jpeg_reset(z);
+      if (!stbi__jpeg_decode_baseline_mcus(z, start, count)) {
+         p->failed[item] = 1;
+         break;
+      }
+   }
+   STBI_FREE(z);
+}
+
+// walk the entropy-coded data up to the first marker that isn't RSTn, noting
+// where each restart interval begins. returns the length through that marker
+// and stores its code in *marker, or returns 0 if the data runs out first.
+// *found is the number of intervals, or -1 if the RSTn markers don't count
+// up from RST0 or outnumber the intervals
+static int stbi__jpeg_find_intervals(const stbi_uc *scan, int len, int *segment, int intervals, int *found, int *marker)
+{
+   const stbi_uc *p = scan, *end = scan + len;
+   int n = 1;
+   segment[0] = 0;
+   for (;;) {
+      const stbi_uc *ff = (const stbi_uc *) memchr(p, 0xff, end - p);
+      if (!ff) return 0;
+      p = ff + 1;
+      while (p < end && *p == 0xff) ++p; // fill bytes
+      if (p == end) return 0;
+      if (*p != 0) {
+         if (!STBI__RESTART(*p)) {
+            *found = n;
+            *marker = *p;
+            if (n > 0) segment[n] = (int) (p + 1 - scan);
+            return (int) (p + 1 - scan);
+         }
+         if (n < 0 || n >= intervals || *p != 0xd0 + ((n-1) & 7))
+            n = -1;
+         else
+            segment[n++] = (int) (p + 1 - scan);
+      }
+      ++p;
+   }
+}
+
+// copy the rest of the scan out of a callback-driven stream, through the
+// marker that ends it, or up to the end of the stream if it is truncated.
+// works a refill at a time, leaving whatever follows the marker unread
+static stbi_uc *stbi__jpeg_read_scan(stbi__context *s, int *len)
+{
+   int n = 0, cap = 1 << 16, ff = 0, done = 0;
+   stbi_uc *buffer = (stbi_uc *) stbi__malloc(cap);
+   if (!buffer) return NULL;
+   while (!done) {
+      stbi_uc *p;
+      int count;
+      if (s->img_buffer >= s->img_buffer_end) {
+         stbi__refill_buffer(s);
+         if (!s->read_from_callbacks) break;
+      }
+      for (p = s->img_buffer; p < s->img_buffer_end && !done; ++p) {
+         done = ff && *p != 0 && *p != 0xff && !STBI__RESTART(*p);
+         ff = *p == 0xff;
       }
+      count = (int) (p - s->img_buffer);
+      while (n + count > cap) {
+         stbi_uc *grown = cap < (1 << 30) ? (stbi_uc *) STBI_REALLOC_SIZED(buffer, cap, cap*2) : NULL;
+         if (!grown) {
+            STBI_FREE(buffer);
+            return NULL;
+         }
+         buffer = grown;
+         cap *= 2;
+      }
+      memcpy(buffer + n, s->img_buffer, count);
+      n += count;
+      s->img_buffer = p;
+   }
+   *len = n;
+   return buffer;
+}
+
+// decode a baseline scan with restart intervals through STBI_PARALLEL_FOR,
+// one run of intervals per work item. returns -1 without touching the stream
+// when the scan is small or doesn't split cleanly into its intervals; a
+// callback stream has been copied by then, so it decodes serially from that
+static int stbi__jpeg_decode_parallel(stbi__jpeg *z)
+{
+   stbi__context *s = z->s, mem;
+   stbi__jpeg_intervals p;
+   stbi_uc *copy = NULL;
+   int *scratch;
+   int avail, scan_len, found = 0, marker = STBI__MARKER_none, item, ok = 1;
+
+   p.mcus = stbi__jpeg_baseline_mcu_count(z);
+   p.intervals = (p.mcus + z->restart_interval - 1) / z->restart_interval;
+   if (p.intervals < 2 || (double) s->img_x * s->img_y < STBI_PARALLEL_MIN_PIXELS) return -1;
+
+   scratch = (int *) stbi__malloc_mad2(p.intervals + 1 + STBI__PARALLEL_MAX_ITEMS, sizeof(int), 0);
+   if (!scratch) return -1;
+   p.segment = scratch;
+   p.failed = scratch + p.intervals + 1;
+
+   if (s->read_from_callbacks) {
+      // the stream can't be rewound, so from here on the scan decodes from a copy
+      copy = stbi__jpeg_read_scan(s, &avail);
+      if (!copy) {
+         STBI_FREE(scratch);
+         return stbi__err("outofmem", "Out of memory");
+      }
+      p.scan = copy;
+   } else {
+      p.scan = s->img_buffer;
+      avail = (int) (s->img_buffer_end - s->img_buffer);
+   }
+
+   scan_len = stbi__jpeg_find_intervals(p.scan, avail, p.segment, p.intervals, &found, &marker);
+   if (!scan_len || found != p.intervals) {
+      STBI_FREE(scratch);
+      if (!copy) return -1;
+      stbi__start_mem(&mem, copy, avail);
+      z->s = &mem;
+      ok = stbi__jpeg_decode_baseline_mcus(z, 0, p.mcus);
+      z->s = s;
+      // the copy ended with the scan's marker, which the stream has moved past
+      if (z->marker == STBI__MARKER_none && scan_len) z->marker = (stbi_uc) marker;
+      STBI_FREE(copy);
+      return ok;
+   }
+
+   p.z = z;
+   p.items = p.intervals < STBI__PARALLEL_MAX_ITEMS ? p.intervals : STBI__PARALLEL_MAX_ITEMS;
+   memset(p.failed, 0, p.items * sizeof(int));
+   STBI_PARALLEL_FOR(p.items, stbi__jpeg_decode_interval_item, &p);
+   for (item=0; item < p.items; ++item)
+      if (p.failed[item]) ok = 0;
+
+   if (!copy) s->img_buffer += scan_len;
+   z->marker = (stbi_uc) marker;
+   STBI_FREE(copy);
+   STBI_FREE(scratch);
+   return ok ? 1 : stbi__err("bad huffman code", "Corrupt JPEG");
+}
+#endif // STBI_PARALLEL_FOR
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+   stbi__jpeg_reset(z);
+   if (!z->progressive) {
+      // once a scan with every component passes the bottom of the window,
+      // nothing left in the file is needed
+      if (z->scan_n == z->s->img_n && stbi__jpeg_baseline_mcu_needed(z) < stbi__jpeg_baseline_mcu_count(z)) {
+         z->done_early = 1;
+         return stbi__jpeg_decode_baseline_mcus(z, 0, stbi__jpeg_baseline_mcu_needed(z));
+      }
+#ifdef STBI_PARALLEL_FOR
+      if (z->restart_interval) {
+         int result = stbi__jpeg_decode_parallel(z);
+         if (result >= 0) return result;
+      }
+#endif
+      return stbi__jpeg_decode_baseline_mcus(z, 0, stbi__jpeg_baseline_mcu_count(z));
    } else {
       if (z->scan_n == 1) {
          int i,j;
@@ -3054,8 +3857,17 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+               stbi_uc *out = stbi__jpeg_block_out(z, n, i, j);
+               if (!out) continue;
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               // coefficient blocks of a row are contiguous, so neighbours can go in pairs
+               if (z->img_comp[n].idct_pair_kernel && i+1 < w && stbi__jpeg_block_out(z, n, i+1, j)) {
+                  stbi__jpeg_dequantize(data+64, z->dequant[z->img_comp[n].tq]);
+                  z->img_comp[n].idct_pair_kernel(out, z->img_comp[n].w2, data);
+                  ++i;
+               } else {
+                  z->img_comp[n].idct_kernel(out, z->img_comp[n].w2, data);
+               }
             }
          }
       }
@@ -3112,8 +3924,10 @@ static int stbi__process_marker(stbi__jpeg *z, int m)
             }
             for (i=0; i < n; ++i)
                v[i] = stbi__get8(z->s);
-            if (tc != 0)
-               stbi__build_fast_ac(z->fast_ac[th], z->huff_ac + th);
+            if (tc == 0)
+               stbi__build_fast_ac(z->fast_dc[th], z->huff_dc + th, 1);
+            else
+               stbi__build_fast_ac(z->fast_ac[th], z->huff_ac + th, 0);
             L -= n;
          }
          return L==0;
@@ -3226,6 +4040,24 @@ static int stbi__free_jpeg_components(stbi__jpeg *z, int ncomp, int why)
    return why;
 }
 
+// allocate the planes for the MCUs of the window, replacing any there were;
+// from here on w2, h2 describe the decoded planes, which only span the window
+static int stbi__jpeg_alloc_planes(stbi__jpeg *z)
+{
+   int i;
+   for (i=0; i < z->s->img_n; ++i) {
+      STBI_FREE(z->img_comp[i].raw_data);
+      z->img_comp[i].w2 = (z->win_x1 - z->win_x0) * z->img_comp[i].h * 8 >> z->img_comp[i].scale;
+      z->img_comp[i].h2 = (z->win_y1 - z->win_y0) * z->img_comp[i].v * 8 >> z->img_comp[i].scale;
+      z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
+      if (z->img_comp[i].raw_data == NULL)
+         return stbi__free_jpeg_components(z, z->s->img_n, stbi__err("outofmem", "Out of memory"));
+      // align blocks for idct using mmx/sse
+      z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
+   }
+   return 1;
+}
+
 static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 {
    stbi__context *s = z->s;
@@ -3283,6 +4115,31 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
    z->img_mcu_x = (s->img_x + z->img_mcu_w-1) / z->img_mcu_w;
    z->img_mcu_y = (s->img_y + z->img_mcu_h-1) / z->img_mcu_h;
 
+   // only the MCUs under the crop, and one more on each side for the
+   // upsampling filters, get reconstructed
+   if (z->crop_x1 <= z->crop_x0 || z->crop_y1 <= z->crop_y0) {
+      z->crop_x0 = z->crop_y0 = 0;
+      z->crop_x1 = s->img_x;
+      z->crop_y1 = s->img_y;
+   }
+   if (z->crop_x0 < 0) z->crop_x0 = 0;
+   if (z->crop_y0 < 0) z->crop_y0 = 0;
+   if (z->crop_x1 > (int) s->img_x) z->crop_x1 = s->img_x;
+   if (z->crop_y1 > (int) s->img_y) z->crop_y1 = s->img_y;
+   if (z->crop_x1 <= z->crop_x0 || z->crop_y1 <= z->crop_y0) return stbi__err("bad crop", "Crop outside image");
+   z->win_x0 = z->crop_x0 / z->img_mcu_w - 1;
+   z->win_y0 = z->crop_y0 / z->img_mcu_h - 1;
+   z->win_x1 = (z->crop_x1 + z->img_mcu_w-1) / z->img_mcu_w + 1;
+   z->win_y1 = (z->crop_y1 + z->img_mcu_h-1) / z->img_mcu_h + 1;
+   if (z->win_x0 < 0) z->win_x0 = 0;
+   if (z->win_y0 < 0) z->win_y0 = 0;
+   if (z->win_x1 > z->img_mcu_x) z->win_x1 = z->img_mcu_x;
+   if (z->win_y1 > z->img_mcu_y) z->win_y1 = z->img_mcu_y;
+   // a streaming load of a baseline image holds three MCU rows at a time
+   z->win_y1_full = z->win_y1;
+   if (z->rows && !z->progressive && z->win_y1 > z->win_y0 + 3)
+      z->win_y1 = z->win_y0 + 3;
+
    for (i=0; i < s->img_n; ++i) {
       // number of effective pixels (e.g. for non-interleaved MCU)
       z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max-1) / h_max;
@@ -3296,14 +4153,19 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // so these muls can't overflow with 32-bit ints (which we require)
       z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
       z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      // a scaled decode keeps subsampled planes closer to full size, so they
+      // come out at the output resolution when the subsampling allows it and
+      // chroma doesn't lose more detail than luma
+      {
+         int hs = h_max / z->img_comp[i].h, vs = v_max / z->img_comp[i].v, cs = z->scale;
+         while (cs > 0 && hs % 2 == 0 && vs % 2 == 0) { --cs; hs /= 2; vs /= 2; }
+         z->img_comp[i].scale = cs;
+         z->img_comp[i].idct_kernel = cs == 0 ? z->idct_block_kernel : cs == 1 ? stbi__idct_4x4 : cs == 2 ? stbi__idct_2x2 : stbi__idct_1x1;
+         z->img_comp[i].idct_pair_kernel = cs == 0 ? z->idct_pair_kernel : NULL;
+      }
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
-      z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
-      if (z->img_comp[i].raw_data == NULL)
-         return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
-      // align blocks for idct using mmx/sse
-      z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
          // w2, h2 are multiples of 8 (see above)
          z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
@@ -3315,7 +4177,7 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       }
    }
 
-   return 1;
+   return stbi__jpeg_alloc_planes(z);
 }
 
 // use comparisons since in some cases we handle more than one case (e.g. SOF)
@@ -3351,6 +4213,8 @@ static int stbi__decode_jpeg_header(stbi__jpeg *z, int scan)
    return 1;
 }
 
+static int stbi__jpeg_stream_scan(stbi__jpeg *z);
+
 // decode image to YCbCr format
 static int stbi__decode_jpeg_image(stbi__jpeg *j)
 {
@@ -3365,7 +4229,18 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
-         if (!stbi__parse_entropy_coded_data(j)) return 0;
+         if (j->win_y1 < j->win_y1_full && j->scan_n == j->s->img_n) {
+            // a baseline scan with every component streams out
+            if (!stbi__jpeg_stream_scan(j)) return 0;
+         } else {
+            if (j->win_y1 < j->win_y1_full) {
+               // one with only some of them needs planes of the whole window
+               j->win_y1 = j->win_y1_full;
+               if (!stbi__jpeg_alloc_planes(j)) return 0;
+            }
+            if (!stbi__parse_entropy_coded_data(j)) return 0;
+         }
+         if (j->done_early) return 1;
          if (j->marker == STBI__MARKER_none ) {
             // handle 0s at the end of image data from IP Kamera 9060
             while (!stbi__at_eof(j->s)) {
@@ -3766,7 +4641,12 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
+   j->scale = 0;
+   j->crop_x0 = j->crop_y0 = j->crop_x1 = j->crop_y1 = 0;
+   j->done_early = 0;
+   j->rows = NULL;
    j->idct_block_kernel = stbi__idct_block;
+   j->idct_pair_kernel = NULL;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
@@ -3778,6 +4658,11 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (stbi__avx2_available())
+      j->idct_pair_kernel = stbi__idct_avx2_pair;
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
@@ -3797,6 +4682,7 @@ typedef struct
    stbi_uc *line0,*line1;
    int hs,vs;   // expansion factor in each axis
    int w_lores; // horizontal pixels pre-expansion
+   int h_lores; // vertical pixels pre-expansion
    int ystep;   // how far through vertical expansion we are
    int ypos;    // which pre-expansion row we're on
 } stbi__resample;
@@ -3808,9 +4694,285 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// upsampling factors of a decoded plane; planes of a scaled decode may have
+// kept some of their subsampling's resolution
+#define stbi__jpeg_upsample_h(z, k)  ((z)->img_h_max / (z)->img_comp[k].h >> ((z)->scale - (z)->img_comp[k].scale))
+#define stbi__jpeg_upsample_v(z, k)  ((z)->img_v_max / (z)->img_comp[k].v >> ((z)->scale - (z)->img_comp[k].scale))
+
+// first row of a plane's window, in rows of that plane
+#define stbi__jpeg_plane_y0(z, k)  ((z)->win_y0 * (z)->img_comp[k].v * (8 >> (z)->img_comp[k].scale))
+
+// upsampled rows start at the left edge of the window; line buffers hold
+// one with room for upsampling off the edges with upsample factor of 4
+#define stbi__jpeg_window_x0(z)  ((z)->win_x0 * (z)->img_mcu_w >> (z)->scale)
+#define stbi__jpeg_line_len(z)   ((((z)->win_x1 - (z)->win_x0) * (z)->img_mcu_w >> (z)->scale) + 3)
+
+// resample and color-convert rows [j0, j1) of the image into output, which
+// points at row j0 of the crop, upsampling into linebuf (one row of
+// stbi__jpeg_line_len bytes per component). rows only depend on the component
+// rows above and below them, so any band can be done on its own
+static void stbi__jpeg_output_rows(stbi__jpeg *z, const stbi__resample *res_comp, stbi_uc **linebuf, stbi_uc *output, int n, int decode_n, int is_rgb, stbi__uint32 j0, stbi__uint32 j1)
+{
+   int k;
+   unsigned int i,j;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   stbi__resample res[4];
+   stbi__uint32 w = z->out_w;
+   int dx = (int) z->out_x0 - stbi__jpeg_window_x0(z);
+
+   // where the row-by-row walk from the top would be when it reaches j0
+   for (k=0; k < decode_n; ++k) {
+      stbi__resample *r = &res[k];
+      int steps = (int) j0 + (res_comp[k].vs >> 1);
+      int lores = steps / res_comp[k].vs;
+      int last = res_comp[k].h_lores - 1;
+      int above = lores ? (lores-1 < last ? lores-1 : last) : 0;
+      *r = res_comp[k];
+      r->ystep = steps % r->vs;
+      r->ypos  = lores;
+      r->line1 = z->img_comp[k].data + z->img_comp[k].w2 * ((lores < last ? lores : last) - stbi__jpeg_plane_y0(z, k));
+      r->line0 = z->img_comp[k].data + z->img_comp[k].w2 * (above - stbi__jpeg_plane_y0(z, k));
+   }
+
+   for (j=j0; j < j1; ++j) {
+      stbi_uc *out = output + n * w * (j - j0);
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < r->h_lores)
+               r->line1 += z->img_comp[k].w2;
+         }
+         coutput[k] += dx;
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < w; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < w; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+               for (i=0; i < w; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+            }
+         } else
+            for (i=0; i < w; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < w; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < w; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < w; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < w; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < w; ++i) out[i] = y[i];
+            else
+               for (i=0; i < w; ++i) { *out++ = y[i]; *out++ = 255; }
+         }
+      }
+   }
+}
+
+#ifdef STBI_PARALLEL_FOR
+typedef struct
 {
+   stbi__jpeg *z;
+   const stbi__resample *res_comp;
+   stbi_uc *output;
    int n, decode_n, is_rgb;
+   int bands;
+   int failed[STBI__PARALLEL_MAX_ITEMS];
+} stbi__jpeg_bands;
+
+static void stbi__jpeg_output_band(void *context, int band)
+{
+   stbi__jpeg_bands *p = (stbi__jpeg_bands *) context;
+   stbi__jpeg *z = p->z;
+   size_t row = (size_t) p->n * z->out_w;
+   stbi__uint32 j0 = (stbi__uint32) ((size_t) z->out_h * band / p->bands);
+   stbi__uint32 j1 = (stbi__uint32) ((size_t) z->out_h * (band+1) / p->bands);
+   stbi_uc *linebuf[4];
+   stbi_uc *last;
+   int k;
+   stbi_uc *lines = (stbi_uc *) stbi__malloc((size_t) p->decode_n * stbi__jpeg_line_len(z) + row + 1);
+   if (!lines) {
+      p->failed[band] = 1;
+      return;
+   }
+   for (k=0; k < p->decode_n; ++k)
+      linebuf[k] = lines + k * stbi__jpeg_line_len(z);
+   last = lines + p->decode_n * stbi__jpeg_line_len(z);
+
+   // the converters store a fourth byte after every pixel even when n is 3,
+   // so the last row goes through a scratch row instead of spilling into the
+   // next band while it is being written
+   stbi__jpeg_output_rows(z, p->res_comp, linebuf, p->output + row * j0, p->n, p->decode_n, p->is_rgb, z->out_y0 + j0, z->out_y0 + j1-1);
+   stbi__jpeg_output_rows(z, p->res_comp, linebuf, last, p->n, p->decode_n, p->is_rgb, z->out_y0 + j1-1, z->out_y0 + j1);
+   memcpy(p->output + row * (j1-1), last, row);
+   STBI_FREE(lines);
+}
+
+// upsample and color-convert in row bands through STBI_PARALLEL_FOR, each
+// band with line buffers of its own. returns 0 if the image is too small
+static int stbi__jpeg_output_bands(stbi__jpeg *z, const stbi__resample *res_comp, stbi_uc *output, int n, int decode_n, int is_rgb)
+{
+   stbi__jpeg_bands p;
+   stbi_uc *linebuf[4];
+   size_t row = (size_t) n * z->out_w;
+   int band, k;
+
+   if ((double) z->out_w * z->out_h < STBI_PARALLEL_MIN_PIXELS || z->out_h < 32) return 0;
+   p.z = z;
+   p.res_comp = res_comp;
+   p.output = output;
+   p.n = n;
+   p.decode_n = decode_n;
+   p.is_rgb = is_rgb;
+   p.bands = z->out_h / 16 < STBI__PARALLEL_MAX_ITEMS ? z->out_h / 16 : STBI__PARALLEL_MAX_ITEMS;
+   memset(p.failed, 0, sizeof(p.failed));
+   STBI_PARALLEL_FOR(p.bands, stbi__jpeg_output_band, &p);
+
+   // bands that couldn't get line buffers still have to be written, keeping
+   // the first byte of the band below from being clobbered by the spill
+   for (k=0; k < decode_n; ++k)
+      linebuf[k] = z->img_comp[k].linebuf;
+   for (band=0; band < p.bands; ++band) {
+      if (p.failed[band]) {
+         stbi__uint32 j0 = (stbi__uint32) ((size_t) z->out_h * band / p.bands);
+         stbi__uint32 j1 = (stbi__uint32) ((size_t) z->out_h * (band+1) / p.bands);
+         stbi_uc next = output[row * j1];
+         stbi__jpeg_output_rows(z, res_comp, linebuf, output + row * j0, n, decode_n, is_rgb, z->out_y0 + j0, z->out_y0 + j1);
+         output[row * j1] = next;
+      }
+   }
+   return 1;
+}
+#endif // STBI_PARALLEL_FOR
+
+// what the output of a jpeg is made of, set up once its markers are read
+typedef struct
+{
+   stbi__resample res_comp[4];
+   stbi_uc *linebuf[4];
+   int n, decode_n, is_rgb;
+} stbi__jpeg_output;
+
+// work out the size and components of the output, and set up the resamplers
+// that produce it with their line buffers
+static int stbi__jpeg_prepare_output(stbi__jpeg *z, int req_comp, stbi__jpeg_output *o)
+{
+   int k, round = (1 << z->scale) - 1;
+   // a scaled decode leaves the planes of a correspondingly smaller image
+   int img_x = (z->s->img_x + round) >> z->scale;
+   int img_y = (z->s->img_y + round) >> z->scale;
+
+   // the crop in output pixels, rounded outwards
+   z->out_x0 = z->crop_x0 >> z->scale;
+   z->out_y0 = z->crop_y0 >> z->scale;
+   z->out_w  = ((z->crop_x1 + round) >> z->scale) - z->out_x0;
+   z->out_h  = ((z->crop_y1 + round) >> z->scale) - z->out_y0;
+
+   // determine actual number of components to generate
+   o->n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+
+   o->is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+
+   if (z->s->img_n == 3 && o->n < 3 && !o->is_rgb)
+      o->decode_n = 1;
+   else
+      o->decode_n = z->s->img_n;
+
+   // nothing to do if no components requested; check this now to avoid
+   // accessing uninitialized coutput[0] later
+   if (o->decode_n <= 0) return 0;
+
+   for (k=0; k < o->decode_n; ++k) {
+      stbi__resample *r = &o->res_comp[k];
+
+      // allocate line buffer big enough for upsampling off the edges
+      // with upsample factor of 4
+      z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(stbi__jpeg_line_len(z));
+      if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
+      o->linebuf[k] = z->img_comp[k].linebuf;
+
+      r->hs      = stbi__jpeg_upsample_h(z, k);
+      r->vs      = stbi__jpeg_upsample_v(z, k);
+      // lores columns of the window, up to the right edge of the image
+      r->w_lores = (img_x + r->hs-1) / r->hs - stbi__jpeg_window_x0(z) / r->hs;
+      if (r->w_lores > z->img_comp[k].w2) r->w_lores = z->img_comp[k].w2;
+      r->h_lores = (img_y + r->vs-1) / r->vs;
+
+      if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+      else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+      else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+      else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+      else                               r->resample = stbi__resample_row_generic;
+   }
+   return 1;
+}
+
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+   stbi__jpeg_output o;
+   stbi_uc *output;
    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
 
    // validate req_comp
@@ -3819,171 +4981,163 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
-   // determine actual number of components to generate
-   n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+   if (!stbi__jpeg_prepare_output(z, req_comp, &o)) { stbi__cleanup_jpeg(z); return NULL; }
 
-   is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+   // can't error after this so, this is safe
+   output = (stbi_uc *) stbi__malloc_mad3(o.n, z->out_w, z->out_h, 1);
+   if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-   if (z->s->img_n == 3 && n < 3 && !is_rgb)
-      decode_n = 1;
-   else
-      decode_n = z->s->img_n;
+   // now go ahead and resample
+#ifdef STBI_PARALLEL_FOR
+   if (!stbi__jpeg_output_bands(z, o.res_comp, output, o.n, o.decode_n, o.is_rgb))
+#endif
+      stbi__jpeg_output_rows(z, o.res_comp, o.linebuf, output, o.n, o.decode_n, o.is_rgb, z->out_y0, z->out_y0 + z->out_h);
+   stbi__cleanup_jpeg(z);
+   z->s->img_x = z->out_w;
+   z->s->img_y = z->out_h;
+   *out_x = z->s->img_x;
+   *out_y = z->s->img_y;
+   if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
+   return output;
+}
 
-   // nothing to do if no components requested; check this now to avoid
-   // accessing uninitialized coutput[0] later
-   if (decode_n <= 0) { stbi__cleanup_jpeg(z); return NULL; }
+// resample rows [j0, j1) of the image, clipped to the crop, into band and
+// hand them to the streaming callback
+static void stbi__jpeg_emit_rows(stbi__jpeg *z, stbi__jpeg_output *o, stbi_uc *band, stbi__uint32 j0, stbi__uint32 j1)
+{
+   if (j0 < z->out_y0) j0 = z->out_y0;
+   if (j1 > z->out_y0 + z->out_h) j1 = z->out_y0 + z->out_h;
+   if (j0 >= j1) return;
+   stbi__jpeg_output_rows(z, o->res_comp, o->linebuf, band, o->n, o->decode_n, o->is_rgb, j0, j1);
+   z->rows->func(z->rows->context, (int) (j0 - z->out_y0), (int) (j1 - j0), band);
+}
 
-   // resample and color-convert
-   {
-      int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+// move the window of planes one MCU row down the image, dropping its top row
+static void stbi__jpeg_slide_window(stbi__jpeg *z)
+{
+   int k;
+   for (k=0; k < z->s->img_n; ++k) {
+      size_t row = (size_t) z->img_comp[k].w2 * (z->img_comp[k].v * 8 >> z->img_comp[k].scale);
+      memmove(z->img_comp[k].data, z->img_comp[k].data + row, (size_t) z->img_comp[k].w2 * z->img_comp[k].h2 - row);
+   }
+   ++z->win_y0;
+   ++z->win_y1;
+}
 
-      stbi__resample res_comp[4];
+// decode a baseline scan of every component one MCU row at a time, sliding
+// the three MCU rows of planes down the image. the rows of each MCU row go
+// out once the MCU row below it, which their upsampling reads, is decoded
+static int stbi__jpeg_stream_scan(stbi__jpeg *z)
+{
+   stbi__jpeg_output o;
+   stbi_uc *band;
+   int r, r0, r1, last, band_h = z->img_mcu_h >> z->scale;
 
-      for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
-
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
-         if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
-
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
-      }
+   if (!stbi__jpeg_prepare_output(z, z->rows->req_comp, &o)) return 0;
+   band = (stbi_uc *) stbi__malloc_mad3(o.n, z->out_w, band_h, 1);
+   if (!band) return stbi__err("outofmem", "Out of memory");
+   stbi__rows_begin(z->rows, z->out_w, z->out_h, z->s->img_n >= 3 ? 3 : 1);
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
-         }
+   // MCU rows holding output rows, and the last one that has to be decoded
+   r0 = z->out_y0 / band_h;
+   r1 = (z->out_y0 + z->out_h - 1) / band_h;
+   last = r1+1 < z->img_mcu_y ? r1+1 : r1;
+
+   stbi__jpeg_reset(z);
+   for (r=0; r <= last; ++r) {
+      int first, count;
+      if (z->scan_n == 1) {
+         // single-component images scan blocks, v rows of them per MCU row
+         int n = z->order[0];
+         int w = (z->img_comp[n].x+7) >> 3, h = (z->img_comp[n].y+7) >> 3;
+         int y0 = r * z->img_comp[n].v, y1 = y0 + z->img_comp[n].v < h ? y0 + z->img_comp[n].v : h;
+         first = y0 * w;
+         count = (y1 - y0) * w;
+      } else {
+         first = r * z->img_mcu_x;
+         count = z->img_mcu_x;
       }
-      stbi__cleanup_jpeg(z);
-      *out_x = z->s->img_x;
-      *out_y = z->s->img_y;
-      if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-      return output;
+      if (r == z->win_y1) stbi__jpeg_slide_window(z);
+      // a scan that ran into a bad marker leaves the rest of the rows as they were
+      if (z->todo > 0 && !stbi__jpeg_decode_baseline_mcus(z, first, count)) { STBI_FREE(band); return 0; }
+      if (r > r0 && r-1 <= r1)
+         stbi__jpeg_emit_rows(z, &o, band, (r-1) * band_h, r * band_h);
+   }
+   if (last == r1)
+      stbi__jpeg_emit_rows(z, &o, band, r1 * band_h, (r1+1) * band_h);
+
+   STBI_FREE(band);
+   z->streamed = 1;
+   // like a cropped load, a scan that stops above the bottom skips the rest
+   if (last+1 < z->img_mcu_y) z->done_early = 1;
+   return 1;
+}
+
+static int stbi__jpeg_decode_rows(stbi__jpeg *z)
+{
+   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+   z->streamed = 0;
+   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return 0; }
+
+   // images that can't stream have whole planes now, which go out in bands
+   if (!z->streamed) {
+      stbi__jpeg_output o;
+      stbi_uc *band;
+      stbi__uint32 j, band_h = z->img_mcu_h >> z->scale;
+      if (!stbi__jpeg_prepare_output(z, z->rows->req_comp, &o)) { stbi__cleanup_jpeg(z); return 0; }
+      band = (stbi_uc *) stbi__malloc_mad3(o.n, z->out_w, band_h, 1);
+      if (!band) { stbi__cleanup_jpeg(z); return stbi__err("outofmem", "Out of memory"); }
+      stbi__rows_begin(z->rows, z->out_w, z->out_h, z->s->img_n >= 3 ? 3 : 1);
+      for (j = z->out_y0; j < z->out_y0 + z->out_h; j += band_h)
+         stbi__jpeg_emit_rows(z, &o, band, j, j + band_h);
+      STBI_FREE(band);
+   }
+   stbi__cleanup_jpeg(z);
+   return 1;
+}
+
+// read the load options into a decoder set up for s
+static stbi__jpeg *stbi__jpeg_begin_load(stbi__context *s)
+{
+   stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
+   if (!j) return (stbi__jpeg *) stbi__errpuc("outofmem", "Out of memory");
+   j->s = s;
+   stbi__setup_jpeg(j);
+   j->scale = stbi__jpeg_scale;
+   j->crop_x0 = stbi__jpeg_crop[0];
+   j->crop_y0 = stbi__jpeg_crop[1];
+   if (stbi__jpeg_crop[2] > 0 && stbi__jpeg_crop[3] > 0) {
+      // kept small enough that the sums can't overflow
+      if (j->crop_x0 > STBI_MAX_DIMENSIONS) j->crop_x0 = STBI_MAX_DIMENSIONS;
+      if (j->crop_y0 > STBI_MAX_DIMENSIONS) j->crop_y0 = STBI_MAX_DIMENSIONS;
+      j->crop_x1 = j->crop_x0 + (stbi__jpeg_crop[2] < STBI_MAX_DIMENSIONS ? stbi__jpeg_crop[2] : STBI_MAX_DIMENSIONS);
+      j->crop_y1 = j->crop_y0 + (stbi__jpeg_crop[3] < STBI_MAX_DIMENSIONS ? stbi__jpeg_crop[3] : STBI_MAX_DIMENSIONS);
    }
+   return j;
 }
 
 static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    unsigned char* result;
-   stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
-   if (!j) return stbi__errpuc("outofmem", "Out of memory");
+   stbi__jpeg* j = stbi__jpeg_begin_load(s);
+   if (!j) return NULL;
    STBI_NOTUSED(ri);
-   j->s = s;
-   stbi__setup_jpeg(j);
    result = load_jpeg_image(j, x,y,comp,req_comp);
    STBI_FREE(j);
    return result;
 }
 
+static int stbi__jpeg_load_rows(stbi__context *s, stbi__rows *rows)
+{
+   int result;
+   stbi__jpeg* j = stbi__jpeg_begin_load(s);
+   if (!j) return 0;
+   j->rows = rows;
+   result = stbi__jpeg_decode_rows(j);
+   STBI_FREE(j);
+   return result;
+}
+
 static int stbi__jpeg_test(stbi__context *s)
 {
    int r;
@@ -4031,10 +5185,18 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
+#define STBI__ZFAST_BITS  11 // accelerate all cases in default tables, most in dynamic ones
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
 
+// C++14 and later build the fixed codes at compile time
+#if (defined(__cplusplus) && __cplusplus >= 201402L) || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#define STBI__ZFIXED_CONSTEXPR
+#define STBI__ZCONSTEXPR constexpr
+#else
+#define STBI__ZCONSTEXPR
+#endif
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -4047,7 +5209,7 @@ typedef struct
    stbi__uint16 value[STBI__ZNSYMS];
 } stbi__zhuffman;
 
-stbi_inline static int stbi__bitreverse16(int n)
+stbi_inline static STBI__ZCONSTEXPR int stbi__bitreverse16(int n)
 {
   n = ((n & 0xAAAA) >>  1) | ((n & 0x5555) << 1);
   n = ((n & 0xCCCC) >>  2) | ((n & 0x3333) << 2);
@@ -4056,7 +5218,7 @@ stbi_inline static int stbi__bitreverse16(int n)
   return n;
 }
 
-stbi_inline static int stbi__bit_reverse(int v, int bits)
+stbi_inline static STBI__ZCONSTEXPR int stbi__bit_reverse(int v, int bits)
 {
    STBI_ASSERT(bits <= 16);
    // to bit reverse n bits, reverse 16 and shift
@@ -4064,14 +5226,15 @@ stbi_inline static int stbi__bit_reverse(int v, int bits)
    return stbi__bitreverse16(v) >> (16-bits);
 }
 
-static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int num)
+static STBI__ZCONSTEXPR int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int num)
 {
-   int i,k=0;
-   int code, next_code[16], sizes[17];
+   int i=0,k=0;
+   int code=0, next_code[16]={0}, sizes[17]={0};
 
    // DEFLATE spec for generating codes
-   memset(sizes, 0, sizeof(sizes));
-   memset(z->fast, 0, sizeof(z->fast));
+   // (loops rather than memset, so this can run at compile time)
+   for (i=0; i < (1 << STBI__ZFAST_BITS); ++i)
+      z->fast[i] = 0;
    for (i=0; i < num; ++i)
       ++sizes[sizelist[i]];
    sizes[0] = 0;
@@ -4121,14 +5284,23 @@ typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
-   stbi__uint32 code_buffer;
+   stbi__uint64 code_buffer;
 
    char *zout;
    char *zout_start;
    char *zout_end;
    int   z_expandable;
 
+   // streaming output: when the buffer fills, the bytes after zflushed go to
+   // zflush, which returns how many it used (or -1 on error), and only the
+   // last 32k and the unused bytes are kept
+   int (*zflush)(void *context, stbi_uc *data, int len);
+   void *zflush_context;
+   char *zflushed;
+
    stbi__zhuffman z_length, z_distance;
+   // codes of the current block: z_length and z_distance, or the fixed ones
+   const stbi__zhuffman *z_block_length, *z_block_distance;
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
@@ -4143,32 +5315,47 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 
 static void stbi__fill_bits(stbi__zbuf *z)
 {
+   // away from the end of the input, take every whole byte that fits in one load
+   if (z->zbuffer_end - z->zbuffer >= 8 && z->num_bits < 56) {
+      stbi_uc *p = z->zbuffer;
+      stbi__uint64 v = (stbi__uint64) p[0] | ((stbi__uint64) p[1] << 8) | ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24)
+                     | ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) | ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+      int n = (63 - z->num_bits) >> 3;
+      if (z->code_buffer >= ((stbi__uint64) 1 << z->num_bits)) {
+        z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
+        return;
+      }
+      z->code_buffer |= (v & (((stbi__uint64) 1 << 8*n) - 1)) << z->num_bits;
+      z->zbuffer += n;
+      z->num_bits += 8*n;
+      return;
+   }
    do {
-      if (z->code_buffer >= (1U << z->num_bits)) {
+      if (z->code_buffer >= ((stbi__uint64) 1 << z->num_bits)) {
         z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
         return;
       }
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
+      z->code_buffer |= (stbi__uint64) stbi__zget8(z) << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   } while (z->num_bits <= 56);
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) stbi__fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) z->code_buffer & ((1 << n) - 1);
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, const stbi__zhuffman *z)
 {
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -4182,7 +5369,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    return z->value[b];
 }
 
-stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
+stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, const stbi__zhuffman *z)
 {
    int b,s;
    if (a->num_bits < 16) {
@@ -4201,11 +5388,30 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
    return stbi__zhuffman_decode_slowpath(a, z);
 }
 
+// hand the bytes not flushed yet to zflush, then slide the rest of the
+// window to the start of the buffer to make room for n bytes
+static int stbi__zslide(stbi__zbuf *z, int n)
+{
+   int used, keep;
+   used = z->zflush(z->zflush_context, (stbi_uc *) z->zflushed, (int) (z->zout - z->zflushed));
+   if (used < 0) return 0;
+   z->zflushed += used;
+   keep = (int) (z->zout - z->zflushed);
+   if (keep < 32768) keep = 32768; // farthest a match can reach back
+   if (keep > z->zout - z->zout_start) keep = (int) (z->zout - z->zout_start);
+   memmove(z->zout_start, z->zout - keep, keep);
+   z->zflushed -= (z->zout - keep) - z->zout_start;
+   z->zout = z->zout_start + keep;
+   if (z->zout_end - z->zout < n) return stbi__err("output buffer limit","Corrupt PNG");
+   return 1;
+}
+
 static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room for n bytes
 {
    char *q;
    unsigned int cur, limit, old_limit;
    z->zout = zout;
+   if (z->zflush) return stbi__zslide(z, n);
    if (!z->z_expandable) return stbi__err("output buffer limit","Corrupt PNG");
    cur   = (unsigned int) (z->zout - z->zout_start);
    limit = old_limit = (unsigned) (z->zout_end - z->zout_start);
@@ -4237,11 +5443,111 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// longest a literal/length code, its extra bits, a distance code and its
+// extra bits can be together
+#define STBI__ZSYMBOL_BITS  (15 + 5 + 15 + 13)
+
+// decode symbols while the input has a word to spare and the output has
+// room for the longest match plus a word, so a refill per symbol covers all
+// of its bits and neither buffer needs checking. the bit buffer lives in
+// locals here, since every byte written could alias *a. matches at least a
+// word back are copied a word at a time, which may write up to 7 bytes past
+// their end. returns 1 at the end of the block, 0 on error and -1 when
+// either buffer runs low, with the state in a updated in every case
+static int stbi__parse_huffman_fast(stbi__zbuf *a)
+{
+   char *zout = a->zout, *zout_start = a->zout_start, *zout_end = a->zout_end;
+   stbi_uc *in = a->zbuffer, *in_end = a->zbuffer_end;
+   stbi__uint64 bits = a->code_buffer;
+   int num_bits = a->num_bits, result = -1;
+   const stbi__uint16 *fast_length = a->z_block_length->fast, *fast_distance = a->z_block_distance->fast;
+
+   while (in_end - in >= 8 && zout_end - zout >= 258 + 8) {
+      int z, b, len, dist, symbol_bits;
+      stbi__uint64 symbol;
+      if (num_bits < STBI__ZSYMBOL_BITS) {
+         // bits of a partly taken byte come in again at the same place next time
+         bits |= ((stbi__uint64) in[0] | ((stbi__uint64) in[1] << 8) | ((stbi__uint64) in[2] << 16) | ((stbi__uint64) in[3] << 24)
+               | ((stbi__uint64) in[4] << 32) | ((stbi__uint64) in[5] << 40) | ((stbi__uint64) in[6] << 48) | ((stbi__uint64) in[7] << 56)) << num_bits;
+         in += (63 - num_bits) >> 3;
+         num_bits |= 56;
+      }
+      // codes too long for the fast tables are left to the careful loop,
+      // which starts over from here
+      symbol = bits;
+      symbol_bits = num_bits;
+      b = fast_length[bits & STBI__ZFAST_MASK];
+      if (!b) break;
+      bits >>= b >> 9;
+      num_bits -= b >> 9;
+      z = b & 511;
+      if (z < 256) {
+         *zout++ = (char) z;
+         // a second literal usually fits in the bits still left
+         b = fast_length[bits & STBI__ZFAST_MASK];
+         if (b && (b & 511) < 256) {
+            bits >>= b >> 9;
+            num_bits -= b >> 9;
+            *zout++ = (char) b;
+         }
+         continue;
+      }
+      if (z == 256) {
+         result = 1;
+         break;
+      }
+      z -= 257;
+      len = stbi__zlength_base[z] + (int) (bits & ((1 << stbi__zlength_extra[z]) - 1));
+      bits >>= stbi__zlength_extra[z];
+      num_bits -= stbi__zlength_extra[z];
+      b = fast_distance[bits & STBI__ZFAST_MASK];
+      if (!b) {
+         bits = symbol;
+         num_bits = symbol_bits;
+         break;
+      }
+      bits >>= b >> 9;
+      num_bits -= b >> 9;
+      z = b & 511;
+      dist = stbi__zdist_base[z] + (int) (bits & ((1 << stbi__zdist_extra[z]) - 1));
+      bits >>= stbi__zdist_extra[z];
+      num_bits -= stbi__zdist_extra[z];
+      if (zout - zout_start < dist) {
+         result = stbi__err("bad dist","Corrupt PNG");
+         break;
+      }
+      if (dist >= 8) {
+         char *p = zout - dist, *end = zout + len;
+         do {
+            memcpy(zout, p, 8);
+            zout += 8;
+            p += 8;
+         } while (zout < end);
+         zout = end;
+      } else if (dist == 1) { // run of one byte; common in images.
+         memset(zout, zout[-1], len);
+         zout += len;
+      } else {
+         char *p = zout - dist;
+         if (len) { do *zout++ = *p++; while (--len); }
+      }
+   }
+
+   a->zout = zout;
+   a->zbuffer = in;
+   a->code_buffer = num_bits < 64 ? bits & (((stbi__uint64) 1 << num_bits) - 1) : bits;
+   a->num_bits = num_bits;
+   return result;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
-   char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      // most symbols go through the fast loop, the rest come here one at a time
+      int z, fast = stbi__parse_huffman_fast(a);
+      char *zout = a->zout;
+      if (fast >= 0) return fast;
+      z = stbi__zhuffman_decode(a, a->z_block_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4259,7 +5565,7 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          z -= 257;
          len = stbi__zlength_base[z];
          if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
-         z = stbi__zhuffman_decode(a, &a->z_distance);
+         z = stbi__zhuffman_decode(a, a->z_block_distance);
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
          dist = stbi__zdist_base[z];
          if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
@@ -4276,6 +5582,7 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
             if (len) { do *zout++ = *p++; while (--len); }
          }
       }
+      a->zout = zout;
    }
 }
 
@@ -4326,6 +5633,8 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
    if (n != ntot) return stbi__err("bad codelengths","Corrupt PNG");
    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
    if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist)) return 0;
+   a->z_block_length = &a->z_length;
+   a->z_block_distance = &a->z_distance;
    return 1;
 }
 
@@ -4337,7 +5646,7 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
       stbi__zreceive(a, a->num_bits & 7); // discard
    // drain the bit-packed data into header
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
       a->code_buffer >>= 8;
       a->num_bits -= 8;
@@ -4349,9 +5658,16 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!stbi__zexpand(a, a->zout, len)) return 0;
+   // the bit buffer may still hold the first bytes of the block
+   while (len > 0 && a->num_bits > 0) {
+      *a->zout++ = (char) (a->code_buffer & 255);
+      a->code_buffer >>= 8;
+      a->num_bits -= 8;
+      --len;
+   }
+   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    memcpy(a->zout, a->zbuffer, len);
    a->zbuffer += len;
    a->zout += len;
@@ -4372,7 +5688,7 @@ static int stbi__parse_zlib_header(stbi__zbuf *a)
    return 1;
 }
 
-static const stbi_uc stbi__zdefault_length[STBI__ZNSYMS] =
+static STBI__ZCONSTEXPR const stbi_uc stbi__zdefault_length[STBI__ZNSYMS] =
 {
    8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8, 8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
    8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8, 8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
@@ -4384,7 +5700,7 @@ static const stbi_uc stbi__zdefault_length[STBI__ZNSYMS] =
    9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9, 9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
    7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7, 7,7,7,7,7,7,7,7,8,8,8,8,8,8,8,8
 };
-static const stbi_uc stbi__zdefault_distance[32] =
+static STBI__ZCONSTEXPR const stbi_uc stbi__zdefault_distance[32] =
 {
    5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5
 };
@@ -4401,6 +5717,45 @@ Init algorithm:
 }
 */
 
+// the codes for fixed huffman blocks only get built once: at compile time in
+// C++, else on first use in each thread. without thread-local storage they
+// are built into the stream's own tables for every fixed block
+#ifdef STBI__ZFIXED_CONSTEXPR
+static constexpr stbi__zhuffman stbi__zfixed_table(const stbi_uc *sizelist, int num)
+{
+   stbi__zhuffman z = {};
+   stbi__zbuild_huffman(&z, sizelist, num);
+   return z;
+}
+
+static constexpr stbi__zhuffman stbi__zfixed_length   = stbi__zfixed_table(stbi__zdefault_length  , STBI__ZNSYMS);
+static constexpr stbi__zhuffman stbi__zfixed_distance = stbi__zfixed_table(stbi__zdefault_distance,  32);
+#elif defined(STBI_THREAD_LOCAL)
+static STBI_THREAD_LOCAL stbi__zhuffman stbi__zfixed_length, stbi__zfixed_distance;
+static STBI_THREAD_LOCAL int stbi__zfixed_built;
+#endif
+
+static int stbi__zfixed_codes(stbi__zbuf *a)
+{
+#if defined(STBI__ZFIXED_CONSTEXPR) || defined(STBI_THREAD_LOCAL)
+#ifndef STBI__ZFIXED_CONSTEXPR
+   if (!stbi__zfixed_built) {
+      if (!stbi__zbuild_huffman(&stbi__zfixed_length  , stbi__zdefault_length  , STBI__ZNSYMS)) return 0;
+      if (!stbi__zbuild_huffman(&stbi__zfixed_distance, stbi__zdefault_distance,  32)) return 0;
+      stbi__zfixed_built = 1;
+   }
+#endif
+   a->z_block_length = &stbi__zfixed_length;
+   a->z_block_distance = &stbi__zfixed_distance;
+#else
+   if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , STBI__ZNSYMS)) return 0;
+   if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+   a->z_block_length = &a->z_length;
+   a->z_block_distance = &a->z_distance;
+#endif
+   return 1;
+}
+
 static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
 {
    int final, type;
@@ -4418,8 +5773,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
       } else {
          if (type == 1) {
             // use fixed code lengths
-            if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , STBI__ZNSYMS)) return 0;
-            if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+            if (!stbi__zfixed_codes(a)) return 0;
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
@@ -4435,10 +5789,27 @@ static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+   a->zflush = NULL;
 
    return stbi__parse_zlib(a, parse_header);
 }
 
+// inflate through a buffer of olen bytes, at least 32k plus whatever flush
+// may leave unused plus 64k, handing all output to flush as it goes
+static int stbi__do_zlib_flush(stbi__zbuf *a, char *obuf, int olen, int parse_header, int (*flush)(void *context, stbi_uc *data, int len), void *context)
+{
+   a->zout_start = obuf;
+   a->zout       = obuf;
+   a->zout_end   = obuf + olen;
+   a->z_expandable = 0;
+   a->zflush = flush;
+   a->zflush_context = context;
+   a->zflushed = obuf;
+
+   if (!stbi__parse_zlib(a, parse_header)) return 0;
+   return flush(context, (stbi_uc *) a->zflushed, (int) (a->zout - a->zflushed)) >= 0;
+}
+
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen)
 {
    stbi__zbuf a;
@@ -4554,6 +5925,7 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   stbi__rows *rows; // streaming load: where finished rows go, NULL otherwise
 } stbi__png;
 
 
@@ -4803,6 +6175,31 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    return 1;
 }
 
+// exact size of the filtered image data: a filter byte and the packed
+// pixels for every row, of each of the 7 passes if interlaced
+static int stbi__png_raw_size(stbi__png *a, int interlaced, stbi__uint32 *raw_len)
+{
+   static const int xorig[] = { 0,4,0,2,0,1,0 };
+   static const int yorig[] = { 0,0,4,0,2,0,1 };
+   static const int xspc[]  = { 8,8,4,4,2,2,1 };
+   static const int yspc[]  = { 8,8,8,4,4,2,2 };
+   int p, total = 0;
+   for (p=0; p < (interlaced ? 7 : 1); ++p) {
+      int x = a->s->img_x, y = a->s->img_y, row;
+      if (interlaced) {
+         x = (x - xorig[p] + xspc[p]-1) / xspc[p];
+         y = (y - yorig[p] + yspc[p]-1) / yspc[p];
+         if (!x || !y) continue;
+      }
+      if (!stbi__mad3sizes_valid(a->s->img_n, x, a->depth, 7)) return stbi__err("too large", "Corrupt PNG");
+      row = ((a->s->img_n * x * a->depth + 7) >> 3) + 1;
+      if (!stbi__mad2sizes_valid(row, y, total)) return stbi__err("too large", "Corrupt PNG");
+      total += row * y;
+   }
+   *raw_len = total;
+   return 1;
+}
+
 static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
 {
    int bytes = (depth == 16 ? 2 : 1);
@@ -4848,10 +6245,9 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    return 1;
 }
 
-static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
+static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n, stbi__uint32 pixel_count)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
+   stbi__uint32 i;
    stbi_uc *p = z->out;
 
    // compute color-based transparency, assuming we've
@@ -4873,10 +6269,9 @@ static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
    return 1;
 }
 
-static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int out_n)
+static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int out_n, stbi__uint32 pixel_count)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
+   stbi__uint32 i;
    stbi__uint16 *p = (stbi__uint16*) z->out;
 
    // compute color-based transparency, assuming we've
@@ -4898,9 +6293,9 @@ static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int ou
    return 1;
 }
 
-static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
+static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, stbi__uint32 pixel_count, int pal_img_n)
 {
-   stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
+   stbi__uint32 i;
    stbi_uc *p, *temp_out, *orig = a->out;
 
    p = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
@@ -4930,8 +6325,6 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
    STBI_FREE(a->out);
    a->out = temp_out;
 
-   STBI_NOTUSED(len);
-
    return 1;
 }
 
@@ -4975,10 +6368,10 @@ STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_conve
                                 : stbi__de_iphone_flag_global)
 #endif // STBI_THREAD_LOCAL
 
-static void stbi__de_iphone(stbi__png *z)
+static void stbi__de_iphone(stbi__png *z, stbi__uint32 pixel_count)
 {
    stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
+   stbi__uint32 i;
    stbi_uc *p = z->out;
 
    if (s->img_out_n == 3) {  // convert bgr to rgb
@@ -5018,6 +6411,172 @@ static void stbi__de_iphone(stbi__png *z)
    }
 }
 
+// how unfiltered rows become the final pixels, worked out at IEND
+typedef struct
+{
+   stbi_uc *palette, *tc;
+   stbi__uint16 *tc16;
+   int pal_img_n, has_trans, is_iphone, color;
+   int raw_n, out_n; // components after unfiltering, and in the end
+} stbi__png_format;
+
+// apply transparency, iphone conversion and the palette to pixel_count
+// unfiltered pixels in z->out
+static int stbi__png_finish_pixels(stbi__png *z, const stbi__png_format *f, stbi__uint32 pixel_count)
+{
+   if (f->has_trans) {
+      if (z->depth == 16) {
+         if (!stbi__compute_transparency16(z, f->tc16, f->raw_n, pixel_count)) return 0;
+      } else {
+         if (!stbi__compute_transparency(z, f->tc, f->raw_n, pixel_count)) return 0;
+      }
+   }
+   if (f->is_iphone && stbi__de_iphone_flag && f->raw_n > 2)
+      stbi__de_iphone(z, pixel_count);
+   if (f->pal_img_n)
+      if (!stbi__expand_png_palette(z, f->palette, pixel_count, f->out_n))
+         return 0;
+   return 1;
+}
+
+// hand rows [y, y+rows) of the image, finished in z->out with n components,
+// to the streaming callback in the requested format; z->out is freed
+static int stbi__png_emit_rows(stbi__png *z, int n, stbi__uint32 y, stbi__uint32 rows)
+{
+   stbi__rows *r = z->rows;
+   stbi_uc *out = z->out;
+   z->out = NULL;
+   // same order of conversions as stbi_load
+   if (r->req_comp && r->req_comp != n) {
+      if (z->depth == 16)
+         out = (stbi_uc *) stbi__convert_format16((stbi__uint16 *) out, n, r->req_comp, z->s->img_x, rows);
+      else
+         out = stbi__convert_format(out, n, r->req_comp, z->s->img_x, rows);
+      if (out == NULL) return 0;
+      n = r->req_comp;
+   }
+   if (z->depth == 16) {
+      stbi_uc *reduced = stbi__convert_16_to_8((stbi__uint16 *) out, z->s->img_x, rows, n);
+      if (reduced == NULL) { STBI_FREE(out); return 0; }
+      out = reduced;
+   }
+   r->func(r->context, (int) y, (int) rows, out);
+   STBI_FREE(out);
+   return 1;
+}
+
+// undo the filter of a row of width bytes, pixels bpp bytes apart, given
+// the unfiltered row above it
+static int stbi__png_unfilter_row(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int filter, stbi__uint32 width, int bpp)
+{
+   stbi__uint32 k;
+   if (filter > 4) return stbi__err("invalid filter","Corrupt PNG");
+   // the first pixel has nothing to its left
+   for (k=0; k < (stbi__uint32) bpp; ++k) {
+      switch (filter) {
+         case STBI__F_none : cur[k] = raw[k]; break;
+         case STBI__F_sub  : cur[k] = raw[k]; break;
+         case STBI__F_up   : cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
+         case STBI__F_avg  : cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1)); break;
+         case STBI__F_paeth: cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
+      }
+   }
+   #define STBI__CASE(f) \
+       case f:     \
+          for (k=bpp; k < width; ++k)
+   switch (filter) {
+      case STBI__F_none:  memcpy(cur+bpp, raw+bpp, width-bpp); break;
+      STBI__CASE(STBI__F_sub)   { cur[k] = STBI__BYTECAST(raw[k] + cur[k-bpp]); } break;
+      STBI__CASE(STBI__F_up)    { cur[k] = STBI__BYTECAST(raw[k] + prior[k]); } break;
+      STBI__CASE(STBI__F_avg)   { cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-bpp])>>1)); } break;
+      STBI__CASE(STBI__F_paeth) { cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-bpp],prior[k],prior[k-bpp])); } break;
+   }
+   #undef STBI__CASE
+   return 1;
+}
+
+typedef struct
+{
+   stbi__png *z;
+   const stbi__png_format *f;
+   stbi__uint32 width;        // bytes of a filtered row, after its filter type
+   int bpp;                   // bytes between pixels the filters look across
+   stbi__uint32 y;            // rows unfiltered so far
+   stbi__uint32 band_rows, band_n;
+   stbi_uc *band;             // unfiltered rows, each after a filter type of none
+   stbi_uc *prior;            // the last row unfiltered, zeros above the first
+} stbi__png_stream;
+
+// finish the rows of the band and hand them over
+static int stbi__png_stream_band(stbi__png_stream *p)
+{
+   stbi__png *z = p->z;
+   if (!stbi__create_png_image_raw(z, p->band, (p->width+1) * p->band_n, p->f->raw_n, z->s->img_x, p->band_n, z->depth, p->f->color)) return 0;
+   if (!stbi__png_finish_pixels(z, p->f, z->s->img_x * p->band_n)) return 0;
+   if (!stbi__png_emit_rows(z, p->f->out_n, p->y - p->band_n, p->band_n)) return 0;
+   p->band_n = 0;
+   return 1;
+}
+
+// zflush callback: unfilter the complete rows of data into bands
+static int stbi__png_stream_flush(void *context, stbi_uc *data, int len)
+{
+   stbi__png_stream *p = (stbi__png_stream *) context;
+   stbi__uint32 used = 0;
+   while (p->y < p->z->s->img_y && len - used > p->width) {
+      stbi_uc *cur = p->band + (p->width+1) * p->band_n;
+      cur[0] = STBI__F_none;
+      if (!stbi__png_unfilter_row(cur+1, data+used+1, p->prior, data[used], p->width, p->bpp)) return -1;
+      p->prior = cur+1;
+      used += p->width+1;
+      ++p->y;
+      if (++p->band_n == p->band_rows || p->y == p->z->s->img_y)
+         if (!stbi__png_stream_band(p)) return -1;
+   }
+   // anything after the last row is ignored, as in whole-image loads
+   return p->y < p->z->s->img_y ? (int) used : len;
+}
+
+// inflate and unfilter a non-interlaced image a band of rows at a time
+static int stbi__png_stream_rows(stbi__png *z, const stbi__png_format *f, stbi__uint32 idata_len)
+{
+   stbi__context *s = z->s;
+   stbi__png_stream p;
+   stbi__zbuf a;
+   char *window;
+   int ok, olen;
+
+   if (!stbi__mad3sizes_valid(s->img_n, s->img_x, z->depth, 7)) return stbi__err("too large", "Corrupt PNG");
+   p.z = z;
+   p.f = f;
+   p.width = (s->img_n * s->img_x * z->depth + 7) >> 3;
+   p.bpp = z->depth < 8 ? 1 : s->img_n * z->depth / 8;
+   p.y = 0;
+   // bands of about 64k, with at least two rows so the prior row of the
+   // first row of a band is never the one being written
+   p.band_rows = (1 << 16) / (p.width+1);
+   if (p.band_rows < 2) p.band_rows = 2;
+   if (p.band_rows > s->img_y) p.band_rows = s->img_y;
+   p.band_n = 0;
+   p.band = (stbi_uc *) stbi__malloc_mad2(p.width+1, p.band_rows, p.width);
+   if (!p.band) return stbi__err("outofmem", "Out of memory");
+   p.prior = p.band + (p.width+1) * p.band_rows;
+   memset(p.prior, 0, p.width);
+
+   olen = 32768 + (p.width+1) + 65536;
+   window = (char *) stbi__malloc(olen);
+   if (!window) { STBI_FREE(p.band); return stbi__err("outofmem", "Out of memory"); }
+
+   stbi__rows_begin(z->rows, s->img_x, s->img_y, f->pal_img_n ? f->pal_img_n : s->img_n + f->has_trans);
+   a.zbuffer = z->idata;
+   a.zbuffer_end = z->idata + idata_len;
+   ok = stbi__do_zlib_flush(&a, window, olen, !f->is_iphone, stbi__png_stream_flush, &p);
+   if (ok && p.y < s->img_y) ok = stbi__err("not enough pixels","Corrupt PNG");
+   STBI_FREE(window);
+   STBI_FREE(p.band);
+   return ok;
+}
+
 #define STBI__PNG_TYPE(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
 static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
@@ -5133,42 +6692,46 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
          }
 
          case STBI__PNG_TYPE('I','E','N','D'): {
-            stbi__uint32 raw_len, bpl;
+            stbi__uint32 raw_len;
+            stbi__png_format f;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
-            z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
-            if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
-            if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
-            if (has_trans) {
-               if (z->depth == 16) {
-                  if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
-               } else {
-                  if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
-               }
+            f.palette = palette;
+            f.tc = tc;
+            f.tc16 = tc16;
+            f.pal_img_n = pal_img_n;
+            f.has_trans = has_trans;
+            f.is_iphone = is_iphone;
+            f.color = color;
+            f.raw_n = s->img_out_n;
+            // pal_img_n == 3 or 4
+            f.out_n = !pal_img_n ? s->img_out_n : req_comp >= 3 ? req_comp : pal_img_n;
+            if (z->rows && !interlace) {
+               if (!stbi__png_stream_rows(z, &f, ioff)) return 0;
+               STBI_FREE(z->idata); z->idata = NULL;
+            } else {
+               // inflate into a buffer of exactly the decoded size, so it only
+               // grows for streams carrying more data than the image needs
+               if (!stbi__png_raw_size(z, interlace, &raw_len)) return 0;
+               z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
+               if (z->expanded == NULL) return 0; // zlib should set error
+               STBI_FREE(z->idata); z->idata = NULL;
+               if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+               if (!stbi__png_finish_pixels(z, &f, s->img_x * s->img_y)) return 0;
+               STBI_FREE(z->expanded); z->expanded = NULL;
             }
-            if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
-               stbi__de_iphone(z);
             if (pal_img_n) {
-               // pal_img_n == 3 or 4
                s->img_n = pal_img_n; // record the actual colors we had
-               s->img_out_n = pal_img_n;
-               if (req_comp >= 3) s->img_out_n = req_comp;
-               if (!stbi__expand_png_palette(z, palette, pal_len, s->img_out_n))
-                  return 0;
             } else if (has_trans) {
                // non-paletted image with tRNS -> source image has (constant) alpha
                ++s->img_n;
             }
-            STBI_FREE(z->expanded); z->expanded = NULL;
+            s->img_out_n = f.out_n;
             // end of PNG chunk, read and skip CRC
             stbi__get32be(s);
             return 1;
@@ -5232,9 +6795,28 @@ static void *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req
 {
    stbi__png p;
    p.s = s;
+   p.rows = NULL;
    return stbi__do_png(&p, x,y,comp,req_comp, ri);
 }
 
+static int stbi__png_load_rows(stbi__context *s, stbi__rows *rows)
+{
+   stbi__png p;
+   int result;
+   p.s = s;
+   p.rows = rows;
+   result = stbi__parse_png_file(&p, STBI__SCAN_load, rows->req_comp);
+   if (result && p.out) {
+      // interlaced images come out whole
+      stbi__rows_begin(rows, s->img_x, s->img_y, s->img_n);
+      result = stbi__png_emit_rows(&p, s->img_out_n, 0, s->img_y);
+   }
+   STBI_FREE(p.out);      p.out      = NULL;
+   STBI_FREE(p.expanded); p.expanded = NULL;
+   STBI_FREE(p.idata);    p.idata    = NULL;
+   return result;
+}
+
 static int stbi__png_test(stbi__context *s)
 {
    int r;
@@ -0,0 +1,46 @@
+#include "gl_ext.h"
+
+GLExtensions glExt;
+
+/*
+ * GLFW hands out an address for any gl* name on some platforms, so a
+ * non-null pointer says nothing about the current context. Each feature
+ * also needs the version or extension that actually provides it.
+ */
+static bool HasVersion(int major, int minor) {
+    GLFWwindow* context = glfwGetCurrentContext();
+    const int contextMajor = glfwGetWindowAttrib(context, GLFW_CONTEXT_VERSION_MAJOR);
+    const int contextMinor = glfwGetWindowAttrib(context, GLFW_CONTEXT_VERSION_MINOR);
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+static bool HasFeature(int major, int minor, const char* extension) {
+    return HasVersion(major, minor) || glfwExtensionSupported(extension);
+}
+
+bool LoadGLExtensions() {
+#define GL_EXT_LOAD(type, name) glExt.name = (type)glfwGetProcAddress("gl" #name);
+    GL_EXT_FUNCTIONS(GL_EXT_LOAD)
+#undef GL_EXT_LOAD
+
+    const bool syncSupported = HasFeature(2, 1, "GL_ARB_pixel_buffer_object") &&
+                               HasFeature(3, 0, "GL_ARB_map_buffer_range") && HasFeature(3, 2, "GL_ARB_sync");
+    glExt.asyncUpload = syncSupported && glExt.GenBuffers && glExt.DeleteBuffers && glExt.BindBuffer && glExt.BufferData &&
+                        glExt.MapBufferRange && glExt.UnmapBuffer && glExt.FenceSync && glExt.ClientWaitSync &&
+                        glExt.WaitSync && glExt.DeleteSync;
+    /* The tile shader is GLSL 330, and texture arrays with instanced attributes came with GL 3.3 */
+    glExt.instancedTiles = HasVersion(3, 3) && glExt.GenBuffers && glExt.BindBuffer && glExt.BufferData && glExt.TexImage3D &&
+                           glExt.TexSubImage3D && glExt.CreateShader && glExt.DeleteShader && glExt.ShaderSource &&
+                           glExt.CompileShader && glExt.GetShaderiv && glExt.GetShaderInfoLog && glExt.CreateProgram &&
+                           glExt.DeleteProgram && glExt.AttachShader && glExt.LinkProgram && glExt.GetProgramiv &&
+                           glExt.GetProgramInfoLog && glExt.UseProgram && glExt.GetUniformLocation && glExt.Uniform1i &&
+                           glExt.Uniform2f && glExt.VertexAttribPointer && glExt.EnableVertexAttribArray &&
+                           glExt.DisableVertexAttribArray && glExt.VertexAttribDivisor && glExt.DrawArraysInstanced;
+    /* EXT_timer_query has no glQueryCounter, only the ARB extension gives timestamps */
+    glExt.timerQueries = HasFeature(3, 3, "GL_ARB_timer_query") && glExt.GenQueries && glExt.DeleteQueries && glExt.QueryCounter && glExt.GetQueryiv &&
+                         glExt.GetQueryObjectiv && glExt.GetQueryObjectui64v;
+    /* The wall tests this pointer itself, so clear it where the context can't copy images */
+    if (!HasFeature(4, 3, "GL_ARB_copy_image"))
+        glExt.CopyImageSubData = nullptr;
+    return glExt.asyncUpload;
+}
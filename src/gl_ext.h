@@ -0,0 +1,69 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <GL/glext.h>
+
+/*
+ * Entry points past GL 1.1, resolved at runtime through GLFW. They live in
+ * a struct instead of global functions so they never clash with symbols
+ * exported by the system GL library.
+ */
+#define GL_EXT_FUNCTIONS(X) \
+    X(PFNGLGENBUFFERSPROC, GenBuffers) \
+    X(PFNGLDELETEBUFFERSPROC, DeleteBuffers) \
+    X(PFNGLBINDBUFFERPROC, BindBuffer) \
+    X(PFNGLBUFFERDATAPROC, BufferData) \
+    X(PFNGLMAPBUFFERRANGEPROC, MapBufferRange) \
+    X(PFNGLUNMAPBUFFERPROC, UnmapBuffer) \
+    X(PFNGLFENCESYNCPROC, FenceSync) \
+    X(PFNGLCLIENTWAITSYNCPROC, ClientWaitSync) \
+    X(PFNGLWAITSYNCPROC, WaitSync) \
+    X(PFNGLDELETESYNCPROC, DeleteSync) \
+    X(PFNGLTEXIMAGE3DPROC, TexImage3D) \
+    X(PFNGLTEXSUBIMAGE3DPROC, TexSubImage3D) \
+    X(PFNGLCOPYIMAGESUBDATAPROC, CopyImageSubData) \
+    X(PFNGLCREATESHADERPROC, CreateShader) \
+    X(PFNGLDELETESHADERPROC, DeleteShader) \
+    X(PFNGLSHADERSOURCEPROC, ShaderSource) \
+    X(PFNGLCOMPILESHADERPROC, CompileShader) \
+    X(PFNGLGETSHADERIVPROC, GetShaderiv) \
+    X(PFNGLGETSHADERINFOLOGPROC, GetShaderInfoLog) \
+    X(PFNGLCREATEPROGRAMPROC, CreateProgram) \
+    X(PFNGLDELETEPROGRAMPROC, DeleteProgram) \
+    X(PFNGLATTACHSHADERPROC, AttachShader) \
+    X(PFNGLLINKPROGRAMPROC, LinkProgram) \
+    X(PFNGLGETPROGRAMIVPROC, GetProgramiv) \
+    X(PFNGLGETPROGRAMINFOLOGPROC, GetProgramInfoLog) \
+    X(PFNGLUSEPROGRAMPROC, UseProgram) \
+    X(PFNGLGETUNIFORMLOCATIONPROC, GetUniformLocation) \
+    X(PFNGLUNIFORM1IPROC, Uniform1i) \
+    X(PFNGLUNIFORM2FPROC, Uniform2f) \
+    X(PFNGLVERTEXATTRIBPOINTERPROC, VertexAttribPointer) \
+    X(PFNGLENABLEVERTEXATTRIBARRAYPROC, EnableVertexAttribArray) \
+    X(PFNGLDISABLEVERTEXATTRIBARRAYPROC, DisableVertexAttribArray) \
+    X(PFNGLVERTEXATTRIBDIVISORPROC, VertexAttribDivisor) \
+    X(PFNGLDRAWARRAYSINSTANCEDPROC, DrawArraysInstanced) \
+    X(PFNGLGENQUERIESPROC, GenQueries) \
+    X(PFNGLDELETEQUERIESPROC, DeleteQueries) \
+    X(PFNGLQUERYCOUNTERPROC, QueryCounter) \
+    X(PFNGLGETQUERYIVPROC, GetQueryiv) \
+    X(PFNGLGETQUERYOBJECTIVPROC, GetQueryObjectiv) \
+    X(PFNGLGETQUERYOBJECTUI64VPROC, GetQueryObjectui64v)
+
+struct GLExtensions {
+#define GL_EXT_DECLARE(type, name) type name = nullptr;
+    GL_EXT_FUNCTIONS(GL_EXT_DECLARE)
+#undef GL_EXT_DECLARE
+
+    /* Pixel buffers and fences, needed by the upload thread */
+    bool asyncUpload = false;
+    /* Shaders, texture arrays and instanced arrays, needed by the tile renderer */
+    bool instancedTiles = false;
+    /* Timestamp queries, needed by GpuTimers */
+    bool timerQueries = false;
+};
+
+extern GLExtensions glExt;
+
+/* Needs a current context, call once after glfwMakeContextCurrent */
+bool LoadGLExtensions();
@@ -0,0 +1,80 @@
+#include "gpu_timers.h"
+
+/* Enough for a few frames of latency with several timed spans each */
+static const int ringSize = 64;
+
+bool GpuTimers::Init() {
+    if (!glExt.timerQueries)
+        return false;
+
+    /* Some drivers expose the entry points with a zero bit counter */
+    GLint bits = 0;
+    glExt.GetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    if (bits == 0)
+        return false;
+
+    queries.resize(ringSize * 2);
+    glExt.GenQueries((GLsizei)queries.size(), queries.data());
+    ring.resize(ringSize);
+    for (int i = 0; i < ringSize; i++)
+        ring[i] = Pair{Stage::Count, queries[i * 2], queries[i * 2 + 1]};
+    head = count = 0;
+    return true;
+}
+
+void GpuTimers::Shutdown() {
+    if (!queries.empty())
+        glExt.DeleteQueries((GLsizei)queries.size(), queries.data());
+    queries.clear();
+    ring.clear();
+    open.clear();
+    head = count = 0;
+}
+
+void GpuTimers::Begin(Stage stage) {
+    if (queries.empty())
+        return;
+
+    if (count == ring.size()) {
+        open.push_back(-1);
+        return;
+    }
+    size_t index = (head + count++) % ring.size();
+    ring[index].stage = stage;
+    glExt.QueryCounter(ring[index].begin, GL_TIMESTAMP);
+    open.push_back((int)index);
+}
+
+void GpuTimers::End() {
+    if (open.empty())
+        return;
+
+    int index = open.back();
+    open.pop_back();
+    if (index >= 0)
+        glExt.QueryCounter(ring[index].end, GL_TIMESTAMP);
+}
+
+void GpuTimers::Collect() {
+    /* A pair whose End hasn't been issued yet blocks the ones behind it, that's fine within a frame */
+    while (count > 0) {
+        Pair& pair = ring[head];
+        for (int index : open) {
+            if (index == (int)head)
+                return;
+        }
+
+        GLint available = 0;
+        glExt.GetQueryObjectiv(pair.end, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        GLuint64 begin = 0, end = 0;
+        glExt.GetQueryObjectui64v(pair.begin, GL_QUERY_RESULT, &begin);
+        glExt.GetQueryObjectui64v(pair.end, GL_QUERY_RESULT, &end);
+        Profiler::Record(pair.stage, end > begin ? end - begin : 0);
+
+        head = (head + 1) % ring.size();
+        count--;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "gl_ext.h"
+#include "profiler.h"
+
+/*
+ * GPU-side durations from GL_TIMESTAMP query pairs. CPU timers around GL
+ * calls only see command submission; these see when the GPU actually ran
+ * the work. Results are polled for, never waited on, so they land in the
+ * profiler a few frames late. Query objects belong to one context, so
+ * every context that measures something owns its own GpuTimers and only
+ * touches it from the thread that context is current on.
+ */
+class GpuTimers {
+public:
+    GpuTimers() = default;
+    GpuTimers(const GpuTimers&) = delete;
+    GpuTimers& operator=(const GpuTimers&) = delete;
+
+    /* Needs the owning context current, false without timer queries */
+    bool Init();
+    void Shutdown();
+    bool IsEnabled() const { return !queries.empty(); }
+
+    /* Brackets GL commands, nesting is fine. Skipped while every pair is still in flight */
+    void Begin(Stage stage);
+    void End();
+
+    /* Records every finished pair, once per frame or upload */
+    void Collect();
+
+private:
+    struct Pair {
+        Stage stage;
+        GLuint begin;
+        GLuint end;
+    };
+
+    /* Pairs in issue order; results come back in order too, so only the oldest is polled */
+    std::vector<GLuint> queries;
+    std::vector<Pair> ring;
+    size_t head = 0;    // oldest pair in flight
+    size_t count = 0;   // pairs in flight
+    std::vector<int> open;  // ring indices of Begin calls still waiting for End, -1 when skipped
+};
@@ -1,23 +1,32 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <cstring>
 #include <inttypes.h>
 #include <GLFW/glfw3.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "../lib/stb/stb_image.h"
+#include "gl_ext.h"
+#include "gpu_timers.h"
+#include "memory_stats.h"
+#include "overlay.h"
+#include "probes.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "recorder.h"
+#include "upload_thread.h"
+#include "video_wall.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 }
 
-bool LoadFrame(const char* filename, int* width, int* height, unsigned char** data) {
+bool LoadFrame(const char* filename, int* width, int* height, PixelBuffer* data) {
     *width = 100;
     *height = 100;
 
-    *data = new unsigned char[100 * 100 * 3];
+    data->resize(100 * 100 * 3);
 
-    auto ptr = *data;
+    auto ptr = data->data();
     
     for (int i = 0; i < 100; i++) {
         for (int j = 0; j < 100; j++) {
@@ -30,10 +39,66 @@ bool LoadFrame(const char* filename, int* width, int* height, unsigned char** da
     return true;
 }
 
-int main(void)
+static void Usage(const char* program) {
+    printf("Usage: %s [options] [video ...]\n"
+           "  --threads N         decode threads shared by the video wall (default: one per core)\n"
+           "  --record FILE       encode the presented frames to FILE\n"
+           "  --record-block      make the render loop wait instead of dropping recorded frames\n"
+           "  --profile FILE      write per-stage latency histograms as JSON (profile builds)\n"
+           "  --perf-counters     add hardware counters to the profile (profile builds)\n"
+           "  --trace FILE        write a Chrome trace of the pipeline (trace builds)\n"
+           "  --hud               start with the performance HUD shown, F1 toggles it\n"
+           "                      (stage times only in profile builds)\n", program);
+}
+
+int main(int argc, char** argv)
 {
     GLFWwindow* window;
 
+    const char* recordPath = NULL;
+    RecordPolicy recordPolicy = RecordPolicy::Drop;
+    int decodeThreads = 0;
+    const char* profilePath = NULL;
+    const char* tracePath = NULL;
+    bool perfCounters = false;
+    bool showHud = false;
+    std::vector<const char*> videoFiles;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (strcmp(argv[i], "--record-block") == 0)
+            recordPolicy = RecordPolicy::Block;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            decodeThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            profilePath = argv[++i];
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (strcmp(argv[i], "--perf-counters") == 0)
+            perfCounters = true;
+        else if (strcmp(argv[i], "--hud") == 0)
+            showHud = true;
+        else if (strcmp(argv[i], "--help") == 0 || argv[i][0] == '-') {
+            Usage(argv[0]);
+            return 1;
+        }
+        else
+            videoFiles.push_back(argv[i]);
+    }
+
+#if FFMPEG_DEMO_TRACE
+    if (tracePath)
+        Tracer::Start();
+#endif
+    TRACE_THREAD_NAME("render");
+
+#if FFMPEG_DEMO_PROFILE
+    if (perfCounters)
+        PerfCounters::Enable();
+#else
+    (void)perfCounters;
+#endif
+
     /* Initialize the library */
     if (!glfwInit())
         return -1;
@@ -48,29 +113,87 @@ int main(void)
     
     /* Make the window's context current */
     glfwMakeContextCurrent(window);
+    LoadGLExtensions();
 
-    int frameWidth, frameHeight;
-    unsigned char* frameData;
-    
-    if (!LoadFrame("video.mp4", &frameWidth, &frameHeight, &frameData)) {
-        printf("Couldn't load video frame\n");
+    /* Hand pixel transfers to the upload thread, fall back to uploading here without fences */
+    UploadThread uploader;
+    uploader.Start(window);
+
+    /* Files on the command line play side by side on a shared decode pool */
+    VideoWall wall;
+    bool wallMode = !videoFiles.empty();
+    int initialWidth, initialHeight;
+    glfwGetFramebufferSize(window, &initialWidth, &initialHeight);
+    if (wallMode && !wall.Open(videoFiles, decodeThreads, uploader.IsRunning() ? &uploader : nullptr,
+                               initialWidth, initialHeight)) {
+        printf("Couldn't open any of the videos\n");
+        uploader.Stop();
+        glfwTerminate();
         return 1;
     }
 
-    GLuint texHandle;
-    glGenTextures(1, &texHandle);
-    glBindTexture(GL_TEXTURE_2D, texHandle);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, frameWidth, frameHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, frameData);;
+    int frameWidth = 0, frameHeight = 0;
+    PixelBuffer frameData;
+    GLuint texHandle = 0;
+    int frameStream = -1;
+
+    if (!wallMode) {
+        if (!LoadFrame("video.mp4", &frameWidth, &frameHeight, &frameData)) {
+            printf("Couldn't load video frame\n");
+            return 1;
+        }
+
+        glGenTextures(1, &texHandle);
+        glBindTexture(GL_TEXTURE_2D, texHandle);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+        if (uploader.IsRunning()) {
+            frameStream = uploader.AddStream(frameWidth, frameHeight);
+            uploader.Submit(frameStream, &frameData, 0);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, frameWidth, frameHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, frameData.data());
+        }
+        /* The texture holds its own copy from here on */
+        PixelBuffer().swap(frameData);
+    }
+
+    /* Optional recording sink, encodes on its own threads */
+    Recorder recorder;
+    if (recordPath) {
+        RecorderSettings settings;
+        settings.filename = recordPath;
+        settings.policy = recordPolicy;
+        glfwGetFramebufferSize(window, &settings.width, &settings.height);
+        if (!recorder.Open(settings))
+            printf("Couldn't start recording to %s\n", recordPath);
+    }
+
+    /* F1 toggles the performance HUD */
+    Overlay overlay;
+    OverlaySources hudSources;
+    hudSources.wall = wallMode ? &wall : nullptr;
+    hudSources.uploader = uploader.IsRunning() ? &uploader : nullptr;
+    hudSources.recorder = recorder.IsOpen() ? &recorder : nullptr;
+    overlay.Init(hudSources);
+    overlay.SetVisible(showHud);
+    bool hudKeyDown = false;
+
+    /* GPU time of render thread uploads and of the draw, read back a few frames late */
+    GpuTimers gpuTimers;
+#if FFMPEG_DEMO_PROFILE
+    gpuTimers.Init();
+#endif
 
     /* Loop until the user closes the window */
+    int64_t renderFrame = 0;
     while (!glfwWindowShouldClose(window))
     {
+        TRACE_SCOPE("frame", renderFrame, -1);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         /* Set up Orthographic Projection */
@@ -82,23 +205,91 @@ int main(void)
         glOrtho(0.0, windowWidth, 0.0, windowHeight, -1, 1);
         glMatrixMode(GL_MODELVIEW);
 
-        glEnable(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, texHandle);
-        glBegin(GL_QUADS);
-            glTexCoord2d(0.0, 0.0); glVertex2i(startPoint, startPoint);
-            glTexCoord2d(1.0, 0.0); glVertex2i(startPoint + frameWidth, startPoint);
-            glTexCoord2d(1.0, 1.0); glVertex2i(startPoint + frameWidth, startPoint + frameHeight);
-            glTexCoord2d(0.0, 1.0); glVertex2i(startPoint, startPoint + frameHeight);
-        glEnd();
-        glDisable(GL_TEXTURE_2D);
+        if (wallMode) {
+            /* Without the upload thread the wall uploads its frames from here */
+            if (!uploader.IsRunning())
+                gpuTimers.Begin(Stage::GpuUpload);
+            wall.Update();
+            if (!uploader.IsRunning())
+                gpuTimers.End();
+        }
+
+        /* The render thread only waits on the upload fence, on the GPU */
+        GLuint frameTexture = texHandle;
+        if (!wallMode && uploader.IsRunning()) {
+            UploadedTexture uploaded;
+            frameTexture = uploader.Acquire(frameStream, &uploaded) ? uploaded.texture : 0;
+        }
+
+        gpuTimers.Begin(Stage::GpuDraw);
+        {
+            PROFILE_SCOPE(Stage::Draw);
+            TRACE_SCOPE("draw", renderFrame, -1);
+            if (wallMode)
+                wall.Draw(windowWidth, windowHeight);
+
+            if (frameTexture) {
+                glEnable(GL_TEXTURE_2D);
+                glBindTexture(GL_TEXTURE_2D, frameTexture);
+                glBegin(GL_QUADS);
+                    glTexCoord2d(0.0, 0.0); glVertex2i(startPoint, startPoint);
+                    glTexCoord2d(1.0, 0.0); glVertex2i(startPoint + frameWidth, startPoint);
+                    glTexCoord2d(1.0, 1.0); glVertex2i(startPoint + frameWidth, startPoint + frameHeight);
+                    glTexCoord2d(0.0, 1.0); glVertex2i(startPoint, startPoint + frameHeight);
+                glEnd();
+                glDisable(GL_TEXTURE_2D);
+            }
+        }
+        gpuTimers.End();
+
+        {
+            TRACE_SCOPE("capture", renderFrame, -1);
+            recorder.CaptureFramebuffer(windowWidth, windowHeight);
+        }
+
+        /* After the capture, so recordings stay clean */
+        overlay.Draw(windowWidth, windowHeight);
 
         /* Swap front and back buffers */
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE(Stage::Swap);
+            TRACE_SCOPE("swap", renderFrame, -1);
+            glfwSwapBuffers(window);
+        }
+        PROBE_FRAME_PRESENTED(renderFrame);
+        gpuTimers.Collect();
+        renderFrame++;
 
         /* Poll for and process events */
         glfwPollEvents();
+        bool hudKey = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+        if (hudKey && !hudKeyDown)
+            overlay.Toggle();
+        hudKeyDown = hudKey;
     }
 
+    overlay.Shutdown();
+    gpuTimers.Shutdown();
+    wall.Close();
+    uploader.Stop();
+    recorder.Close();
+    if (recordPath)
+        printf("Recorded %" PRIu64 " frames, dropped %" PRIu64 "\n", recorder.FramesEncoded(), recorder.FramesDropped());
+    MemoryStats::Print();
+
+#if FFMPEG_DEMO_PROFILE
+    if (profilePath)
+        Profiler::WriteSummary(profilePath);
+#else
+    (void)profilePath;
+#endif
+#if FFMPEG_DEMO_TRACE
+    if (tracePath)
+        Tracer::WriteTrace(tracePath);
+#else
+    (void)tracePath;
+#endif
+
     glfwTerminate();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "memory_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+
+namespace {
+
+struct CategoryCounters {
+    std::atomic<int64_t> current{0};
+    std::atomic<int64_t> peak{0};
+};
+
+CategoryCounters counters[MemoryCategoryCount];
+
+/* Keeps the size in front of each stb allocation, padded so the block stays 16 byte aligned */
+constexpr size_t StbHeader = 16;
+
+}
+
+const char* MemoryStats::Name(MemoryCategory category) {
+    switch (category) {
+    case MemoryCategory::Packets: return "packets";
+    case MemoryCategory::Frames: return "frames";
+    case MemoryCategory::Conversion: return "conversion";
+    case MemoryCategory::Textures: return "textures";
+    case MemoryCategory::Capture: return "capture";
+    case MemoryCategory::StbImage: return "stb_image";
+    default: return "unknown";
+    }
+}
+
+void MemoryStats::Add(MemoryCategory category, int64_t bytes) {
+    CategoryCounters& counter = counters[(int)category];
+    int64_t now = counter.current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = counter.peak.load(std::memory_order_relaxed);
+    while (now > peak && !counter.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+    }
+}
+
+void MemoryStats::Snapshot(MemoryUsage (&usage)[MemoryCategoryCount]) {
+    for (int c = 0; c < MemoryCategoryCount; c++) {
+        usage[c].current = counters[c].current.load(std::memory_order_relaxed);
+        usage[c].peak = counters[c].peak.load(std::memory_order_relaxed);
+    }
+}
+
+void MemoryStats::Print() {
+    MemoryUsage usage[MemoryCategoryCount];
+    Snapshot(usage);
+    printf("Memory (MB)    current      peak\n");
+    for (int c = 0; c < MemoryCategoryCount; c++) {
+        printf("  %-12s %9.2f %9.2f\n", Name((MemoryCategory)c),
+               usage[c].current / (1024.0 * 1024.0), usage[c].peak / (1024.0 * 1024.0));
+    }
+}
+
+void* MemoryStats::StbMalloc(size_t size) {
+    unsigned char* block = (unsigned char*)malloc(size + StbHeader);
+    if (!block)
+        return NULL;
+    *(size_t*)block = size;
+    Add(MemoryCategory::StbImage, (int64_t)size);
+    return block + StbHeader;
+}
+
+void* MemoryStats::StbRealloc(void* pointer, size_t size) {
+    if (!pointer)
+        return StbMalloc(size);
+
+    unsigned char* block = (unsigned char*)pointer - StbHeader;
+    size_t oldSize = *(size_t*)block;
+    unsigned char* grown = (unsigned char*)realloc(block, size + StbHeader);
+    if (!grown)
+        return NULL;
+    *(size_t*)grown = size;
+    Add(MemoryCategory::StbImage, (int64_t)size - (int64_t)oldSize);
+    return grown + StbHeader;
+}
+
+void MemoryStats::StbFree(void* pointer) {
+    if (!pointer)
+        return;
+    unsigned char* block = (unsigned char*)pointer - StbHeader;
+    Add(MemoryCategory::StbImage, -(int64_t)*(size_t*)block);
+    free(block);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+/*
+ * Live byte counts per kind of buffer, with high-water marks. Pixel buffers
+ * are counted exactly through TrackedAllocator and stb_image through its
+ * STBI_MALLOC hooks; FFmpeg packets and frames count the buffers a reader
+ * holds references to, and GPU memory is estimated from texture sizes.
+ */
+enum class MemoryCategory {
+    Packets,
+    Frames,
+    Conversion,     // RGB frames between the converter and the upload
+    Textures,       // estimated, GL owns the real allocations
+    Capture,        // recorder readback slots
+    StbImage,
+    Count
+};
+
+constexpr int MemoryCategoryCount = (int)MemoryCategory::Count;
+
+struct MemoryUsage {
+    int64_t current = 0;
+    int64_t peak = 0;
+};
+
+namespace MemoryStats {
+    const char* Name(MemoryCategory category);
+
+    /* Negative to release */
+    void Add(MemoryCategory category, int64_t bytes);
+    void Snapshot(MemoryUsage (&usage)[MemoryCategoryCount]);
+    void Print();
+
+    /* Drivers usually pad RGB8 texels to four bytes */
+    inline int64_t TextureBytes(int width, int height, int layers = 1) {
+        return (int64_t)width * height * layers * 4;
+    }
+
+    /* For STBI_MALLOC, STBI_REALLOC and STBI_FREE */
+    void* StbMalloc(size_t size);
+    void* StbRealloc(void* pointer, size_t size);
+    void StbFree(void* pointer);
+}
+
+/* Bytes held by one owner, given back when the owner goes away */
+class MemoryCharge {
+public:
+    explicit MemoryCharge(MemoryCategory category) : category(category) {}
+    MemoryCharge(const MemoryCharge&) = delete;
+    MemoryCharge& operator=(const MemoryCharge&) = delete;
+    ~MemoryCharge() { Set(0); }
+
+    void Set(int64_t bytes) {
+        if (bytes != charged)
+            MemoryStats::Add(category, bytes - charged);
+        charged = bytes;
+    }
+    void Add(int64_t bytes) { Set(charged + bytes); }
+    int64_t Bytes() const { return charged; }
+
+private:
+    MemoryCategory category;
+    int64_t charged = 0;
+};
+
+template <typename T, MemoryCategory Category>
+struct TrackedAllocator {
+    using value_type = T;
+    template <typename U>
+    struct rebind { using other = TrackedAllocator<U, Category>; };
+
+    TrackedAllocator() = default;
+    template <typename U>
+    TrackedAllocator(const TrackedAllocator<U, Category>&) {}
+
+    T* allocate(size_t n) {
+        T* pointer = std::allocator<T>().allocate(n);
+        MemoryStats::Add(Category, (int64_t)(n * sizeof(T)));
+        return pointer;
+    }
+    void deallocate(T* pointer, size_t n) {
+        MemoryStats::Add(Category, -(int64_t)(n * sizeof(T)));
+        std::allocator<T>().deallocate(pointer, n);
+    }
+
+    template <typename U>
+    bool operator==(const TrackedAllocator<U, Category>&) const { return true; }
+};
+
+/* Tightly packed RGB24 frames on their way to the GPU */
+using PixelBuffer = std::vector<unsigned char, TrackedAllocator<unsigned char, MemoryCategory::Conversion>>;
@@ -0,0 +1,368 @@
+#include "overlay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "memory_stats.h"
+#include "recorder.h"
+#include "upload_thread.h"
+#include "video_wall.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace {
+
+/* Printable ASCII from the public domain font8x8_basic, bit 0 is the leftmost pixel */
+constexpr int FirstGlyph = 32;
+constexpr int GlyphCount = 96;          // 32..126 plus a solid block for the panel
+constexpr int SolidGlyph = GlyphCount - 1;
+constexpr int GlyphSize = 8;
+constexpr int AtlasColumns = 16;
+constexpr int AtlasRows = GlyphCount / AtlasColumns;
+constexpr int AtlasWidth = AtlasColumns * GlyphSize;
+constexpr int AtlasHeight = AtlasRows * GlyphSize;
+
+const unsigned char Font[GlyphCount - 1][GlyphSize] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},   // ' '
+    {0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00},   // '!'
+    {0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},   // '"'
+    {0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00},   // '#'
+    {0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00},   // '$'
+    {0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00},   // '%'
+    {0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00},   // '&'
+    {0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00},   // '''
+    {0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00},   // '('
+    {0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00},   // ')'
+    {0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00},   // '*'
+    {0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00},   // '+'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06},   // ','
+    {0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00},   // '-'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00},   // '.'
+    {0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00},   // '/'
+    {0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00},   // '0'
+    {0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00},   // '1'
+    {0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00},   // '2'
+    {0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00},   // '3'
+    {0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00},   // '4'
+    {0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00},   // '5'
+    {0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00},   // '6'
+    {0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00},   // '7'
+    {0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00},   // '8'
+    {0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00},   // '9'
+    {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00},   // ':'
+    {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06},   // ';'
+    {0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00},   // '<'
+    {0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00},   // '='
+    {0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00},   // '>'
+    {0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00},   // '?'
+    {0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00},   // '@'
+    {0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00},   // 'A'
+    {0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00},   // 'B'
+    {0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00},   // 'C'
+    {0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00},   // 'D'
+    {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00},   // 'E'
+    {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00},   // 'F'
+    {0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00},   // 'G'
+    {0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00},   // 'H'
+    {0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   // 'I'
+    {0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00},   // 'J'
+    {0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00},   // 'K'
+    {0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00},   // 'L'
+    {0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00},   // 'M'
+    {0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00},   // 'N'
+    {0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00},   // 'O'
+    {0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00},   // 'P'
+    {0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00},   // 'Q'
+    {0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00},   // 'R'
+    {0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00},   // 'S'
+    {0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   // 'T'
+    {0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00},   // 'U'
+    {0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00},   // 'V'
+    {0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00},   // 'W'
+    {0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00},   // 'X'
+    {0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00},   // 'Y'
+    {0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00},   // 'Z'
+    {0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00},   // '['
+    {0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00},   // '\'
+    {0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00},   // ']'
+    {0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00},   // '^'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF},   // '_'
+    {0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00},   // '`'
+    {0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00},   // 'a'
+    {0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00},   // 'b'
+    {0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00},   // 'c'
+    {0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00},   // 'd'
+    {0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00},   // 'e'
+    {0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00},   // 'f'
+    {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F},   // 'g'
+    {0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00},   // 'h'
+    {0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   // 'i'
+    {0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E},   // 'j'
+    {0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00},   // 'k'
+    {0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   // 'l'
+    {0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00},   // 'm'
+    {0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00},   // 'n'
+    {0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00},   // 'o'
+    {0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F},   // 'p'
+    {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78},   // 'q'
+    {0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00},   // 'r'
+    {0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00},   // 's'
+    {0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00},   // 't'
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00},   // 'u'
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00},   // 'v'
+    {0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00},   // 'w'
+    {0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00},   // 'x'
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F},   // 'y'
+    {0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00},   // 'z'
+    {0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00},   // '{'
+    {0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00},   // '|'
+    {0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00},   // '}'
+    {0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},   // '~'
+};
+
+constexpr float Scale = 2.0f;
+constexpr float CharWidth = GlyphSize * Scale;
+constexpr float LineHeight = (GlyphSize + 2) * Scale;
+constexpr float Margin = 8.0f;
+constexpr double RefreshSeconds = 0.5;
+
+const unsigned char TextColor[4] = {255, 255, 255, 255};
+const unsigned char PanelColor[4] = {0, 0, 0, 160};
+
+double ResidentMegabytes() {
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    unsigned long long size = 0, resident = 0;
+    int read = fscanf(file, "%llu %llu", &size, &resident);
+    fclose(file);
+    return read == 2 ? resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0) : 0;
+#else
+    return 0;
+#endif
+}
+
+#if FFMPEG_DEMO_PROFILE
+/* Mean of the samples recorded since the previous snapshot, in milliseconds */
+void FormatStage(char* out, size_t size, const StageSummary& now, const StageSummary& before) {
+    uint64_t count = now.count - before.count;
+    if (!count) {
+        snprintf(out, size, "-");
+        return;
+    }
+    double sum = now.mean * now.count - before.mean * before.count;
+    snprintf(out, size, "%.2f ms", sum / count / 1000.0);
+}
+#endif
+
+}
+
+Overlay::~Overlay() {
+    Shutdown();
+}
+
+bool Overlay::Init(const OverlaySources& overlaySources) {
+    sources = overlaySources;
+
+    std::vector<unsigned char> pixels(AtlasWidth * AtlasHeight, 0);
+    for (int glyph = 0; glyph < GlyphCount; glyph++) {
+        int left = glyph % AtlasColumns * GlyphSize;
+        int top = glyph / AtlasColumns * GlyphSize;
+        for (int y = 0; y < GlyphSize; y++) {
+            unsigned char bits = glyph == SolidGlyph ? 0xff : Font[glyph][y];
+            for (int x = 0; x < GlyphSize; x++)
+                pixels[(top + y) * AtlasWidth + left + x] = (bits >> x) & 1 ? 255 : 0;
+        }
+    }
+
+    glGenTextures(1, &atlas);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, AtlasWidth, AtlasHeight, 0, GL_ALPHA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    Profiler::Snapshot(previous);
+    lastRefresh = Clock::now();
+    Refresh(0);
+    return atlas != 0;
+}
+
+void Overlay::Shutdown() {
+    if (atlas) {
+        glDeleteTextures(1, &atlas);
+        atlas = 0;
+    }
+    vertices.clear();
+}
+
+void Overlay::Draw(int windowWidth, int windowHeight) {
+    if (!atlas)
+        return;
+
+    auto start = Clock::now();
+    framesSinceRefresh++;
+    double sinceRefresh = std::chrono::duration<double>(start - lastRefresh).count();
+    if (sinceRefresh >= RefreshSeconds) {
+        Refresh(sinceRefresh);
+        lastRefresh = start;
+    }
+    if (!visible || vertices.empty())
+        return;
+
+    PROFILE_SCOPE(Stage::Overlay);
+    (void)windowWidth;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    /* Laid out downwards from the top left corner, the projection has y up */
+    glLoadIdentity();
+    glTranslatef(Margin, (float)windowHeight - Margin, 0.0f);
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(Vertex), &vertices[0].x);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), &vertices[0].u);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), vertices[0].color);
+    glDrawArrays(GL_QUADS, 0, (GLsizei)vertices.size());
+
+    glPopMatrix();
+    glPopClientAttrib();
+    glPopAttrib();
+
+    drawSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void Overlay::Refresh(double seconds) {
+    StageSummary summary[StageCount];
+    Profiler::Snapshot(summary);
+
+    char text[128];
+    const int frames = framesSinceRefresh;
+    if (frames)
+        drawMs = drawSeconds * 1000.0 / frames;
+    framesSinceRefresh = 0;
+    drawSeconds = 0;
+
+    /* The panel quad goes first so the text blends over it, its size is patched once the text is known */
+    vertices.clear();
+    lines = 0;
+    columns = 0;
+    AddQuad(0, 0, 0, 0, SolidGlyph, PanelColor);
+
+    const double fps = seconds > 0 ? frames / seconds : 0;
+    snprintf(text, sizeof(text), "fps %.1f  frame %.2f ms", fps, fps > 0 ? 1000.0 / fps : 0.0);
+    AddLine(text);
+
+    /* Only profile builds record stage samples, elsewhere these lines would read "-" forever */
+#if FFMPEG_DEMO_PROFILE
+    char a[32], b[32], c[32];
+    auto stage = [&](Stage s, char* out) {
+        FormatStage(out, 32, summary[(int)s], previous[(int)s]);
+    };
+    stage(Stage::Decode, a);
+    stage(Stage::Convert, b);
+    stage(Stage::Upload, c);
+    snprintf(text, sizeof(text), "decode %s  convert %s  upload %s", a, b, c);
+    AddLine(text);
+    stage(Stage::Demux, a);
+    stage(Stage::Draw, b);
+    stage(Stage::Swap, c);
+    snprintf(text, sizeof(text), "demux %s  draw %s  swap %s", a, b, c);
+    AddLine(text);
+    stage(Stage::GpuUpload, a);
+    stage(Stage::GpuDraw, b);
+    snprintf(text, sizeof(text), "gpu upload %s  draw %s", a, b);
+    AddLine(text);
+#endif
+
+    snprintf(text, sizeof(text), "queued decode %d  upload %d  record %d",
+             sources.wall ? sources.wall->DecodesInFlight() : 0,
+             sources.uploader ? sources.uploader->QueuedFrames() : 0,
+             sources.recorder ? sources.recorder->QueuedFrames() : 0);
+    AddLine(text);
+
+    snprintf(text, sizeof(text), "dropped upload %llu  record %llu",
+             (unsigned long long)(sources.uploader ? sources.uploader->FramesDropped() : 0),
+             (unsigned long long)(sources.recorder ? sources.recorder->FramesDropped() : 0));
+    AddLine(text);
+
+    MemoryUsage memory[MemoryCategoryCount];
+    MemoryStats::Snapshot(memory);
+    auto mb = [&](MemoryCategory c) { return memory[(int)c].current / (1024.0 * 1024.0); };
+    int64_t tracked = 0, trackedPeak = 0;
+    for (const MemoryUsage& usage : memory) {
+        tracked += usage.current;
+        trackedPeak += usage.peak;
+    }
+    snprintf(text, sizeof(text), "rss %.1f MB  tracked %.1f MB  peaks %.1f MB", ResidentMegabytes(),
+             tracked / (1024.0 * 1024.0), trackedPeak / (1024.0 * 1024.0));
+    AddLine(text);
+    snprintf(text, sizeof(text), "packets %.1f  frames %.1f  rgb %.1f  tex %.1f  capture %.1f  stb %.1f",
+             mb(MemoryCategory::Packets), mb(MemoryCategory::Frames), mb(MemoryCategory::Conversion),
+             mb(MemoryCategory::Textures), mb(MemoryCategory::Capture), mb(MemoryCategory::StbImage));
+    AddLine(text);
+
+    snprintf(text, sizeof(text), "hud %.3f ms  [F1]", drawMs);
+    AddLine(text);
+
+    const float pad = Scale * 2;
+    Vertex* panel = vertices.data();
+    panel[0].x = panel[3].x = -pad;
+    panel[1].x = panel[2].x = columns * CharWidth + pad;
+    panel[0].y = panel[1].y = pad;
+    panel[2].y = panel[3].y = -lines * LineHeight - pad;
+
+    std::copy(std::begin(summary), std::end(summary), std::begin(previous));
+}
+
+void Overlay::AddLine(const char* text) {
+    const float top = -lines * LineHeight;
+    int length = 0;
+    for (const char* p = text; *p; p++, length++) {
+        int glyph = (unsigned char)*p - FirstGlyph;
+        if (glyph <= 0 || glyph >= SolidGlyph)
+            continue;
+        const float left = length * CharWidth;
+        AddQuad(left, top, left + CharWidth, top - GlyphSize * Scale, glyph, TextColor);
+    }
+    columns = std::max(columns, length);
+    lines++;
+}
+
+void Overlay::AddQuad(float x0, float y0, float x1, float y1, int glyph, const unsigned char color[4]) {
+    float u0 = (float)(glyph % AtlasColumns * GlyphSize) / AtlasWidth;
+    float v0 = (float)(glyph / AtlasColumns * GlyphSize) / AtlasHeight;
+    float u1 = u0 + (float)GlyphSize / AtlasWidth;
+    float v1 = v0 + (float)GlyphSize / AtlasHeight;
+
+    /* The solid glyph is sampled at its center so the panel edges never pick up neighbours */
+    if (glyph == SolidGlyph) {
+        u0 = u1 = (u0 + u1) * 0.5f;
+        v0 = v1 = (v0 + v1) * 0.5f;
+    }
+
+    const Vertex quad[4] = {
+        {x0, y0, u0, v0, {color[0], color[1], color[2], color[3]}},
+        {x1, y0, u1, v0, {color[0], color[1], color[2], color[3]}},
+        {x1, y1, u1, v1, {color[0], color[1], color[2], color[3]}},
+        {x0, y1, u0, v1, {color[0], color[1], color[2], color[3]}},
+    };
+    vertices.insert(vertices.end(), std::begin(quad), std::end(quad));
+}
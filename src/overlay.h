@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#include "gl_ext.h"
+#include "profiler.h"
+
+class Recorder;
+class UploadThread;
+class VideoWall;
+
+/* Whatever the HUD reports on, any of them may be missing */
+struct OverlaySources {
+    VideoWall* wall = nullptr;
+    UploadThread* uploader = nullptr;
+    Recorder* recorder = nullptr;
+};
+
+/*
+ * Heads-up display with frame rate, queue depths, drops and memory, plus
+ * CPU and GPU stage times in builds with FFMPEG_DEMO_PROFILE; other builds
+ * record no stage samples, so those lines are left out. The 8x8 font is
+ * rasterized once into an alpha atlas; the text is laid out into a vertex
+ * list twice a second and every frame in between is a single glDrawArrays
+ * of textured quads, so drawing it costs far less than the numbers it shows.
+ */
+class Overlay {
+public:
+    Overlay() = default;
+    Overlay(const Overlay&) = delete;
+    Overlay& operator=(const Overlay&) = delete;
+    ~Overlay();
+
+    /* Needs a current context */
+    bool Init(const OverlaySources& sources);
+    void Shutdown();
+
+    void Toggle() { visible = !visible; }
+    void SetVisible(bool show) { visible = show; }
+    bool IsVisible() const { return visible; }
+
+    /* Once per frame after the scene, frames are counted even while hidden */
+    void Draw(int windowWidth, int windowHeight);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Vertex {
+        float x, y, u, v;
+        unsigned char color[4];
+    };
+
+    void Refresh(double seconds);
+    void AddLine(const char* text);
+    void AddQuad(float x0, float y0, float x1, float y1, int glyph, const unsigned char color[4]);
+
+    OverlaySources sources;
+    GLuint atlas = 0;
+    bool visible = false;
+
+    std::vector<Vertex> vertices;
+    int lines = 0;
+    int columns = 0;
+
+    Clock::time_point lastRefresh;
+    int framesSinceRefresh = 0;
+    double drawSeconds = 0;     // time spent in Draw since the last refresh
+    double drawMs = 0;          // average of the previous interval
+    StageSummary previous[StageCount];
+};
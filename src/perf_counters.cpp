@@ -0,0 +1,123 @@
+#include "perf_counters.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::atomic<bool> enabled{false};
+
+#ifdef __linux__
+
+struct ThreadCounters {
+    int fds[PerfCounterCount];
+    bool opened = false;
+    bool failed = false;
+
+    ThreadCounters() {
+        for (int& fd : fds)
+            fd = -1;
+    }
+    ~ThreadCounters() {
+        for (int fd : fds)
+            if (fd >= 0)
+                close(fd);
+    }
+
+    bool Open() {
+        static const uint64_t configs[PerfCounterCount] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES,
+        };
+
+        for (int i = 0; i < PerfCounterCount; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            /* pid 0, cpu -1: this thread on whatever core it runs */
+            fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, i ? fds[0] : -1, 0);
+            if (fds[i] < 0) {
+                failed = true;
+                return false;
+            }
+        }
+        opened = true;
+        return true;
+    }
+};
+
+ThreadCounters& LocalCounters() {
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+#endif
+
+}
+
+const char* PerfCounters::Name(PerfCounter counter) {
+    switch (counter) {
+    case PerfCounter::Cycles: return "cycles";
+    case PerfCounter::Instructions: return "instructions";
+    case PerfCounter::CacheMisses: return "llc_misses";
+    case PerfCounter::BranchMisses: return "branch_misses";
+    default: return "unknown";
+    }
+}
+
+bool PerfCounters::Enable() {
+#ifdef __linux__
+    enabled.store(true, std::memory_order_relaxed);
+    PerfSample sample;
+    if (!Read(&sample)) {
+        enabled.store(false, std::memory_order_relaxed);
+        printf("Hardware counters unavailable, check /proc/sys/kernel/perf_event_paranoid\n");
+        return false;
+    }
+    return true;
+#else
+    printf("Hardware counters are only supported on Linux\n");
+    return false;
+#endif
+}
+
+bool PerfCounters::IsEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+bool PerfCounters::Read(PerfSample* sample) {
+#ifdef __linux__
+    if (!IsEnabled())
+        return false;
+
+    ThreadCounters& counters = LocalCounters();
+    if (!counters.opened && (counters.failed || !counters.Open()))
+        return false;
+
+    /* PERF_FORMAT_GROUP layout: count, then one value per counter */
+    uint64_t buffer[1 + PerfCounterCount];
+    if (read(counters.fds[0], buffer, sizeof(buffer)) != (ssize_t)sizeof(buffer))
+        return false;
+    for (int i = 0; i < PerfCounterCount; i++)
+        sample->values[i] = buffer[1 + i];
+    return true;
+#else
+    (void)sample;
+    return false;
+#endif
+}
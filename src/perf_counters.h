@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Hardware counters for the calling thread through perf_event_open. Each
+ * thread lazily opens one counter group and reads all of it with a single
+ * read(). Only Linux has an implementation; elsewhere Enable fails and the
+ * profiler keeps reporting wall times alone.
+ */
+enum class PerfCounter {
+    Cycles,
+    Instructions,
+    CacheMisses,    // last level cache
+    BranchMisses,
+    Count
+};
+
+constexpr int PerfCounterCount = (int)PerfCounter::Count;
+
+struct PerfSample {
+    uint64_t values[PerfCounterCount] = {};
+};
+
+namespace PerfCounters {
+    const char* Name(PerfCounter counter);
+
+    /* Opens counters on the calling thread to check they are usable */
+    bool Enable();
+    bool IsEnabled();
+
+    /* False when counters are off or this thread couldn't open them */
+    bool Read(PerfSample* sample);
+}
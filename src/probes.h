@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+ * User space static tracepoints (USDT) under the "ffmpeg_demo" provider.
+ * With <sys/sdt.h> each probe is a single nop plus a note section entry, so
+ * they stay compiled in; bpftrace or perf can attach to a running process:
+ *
+ *   bpftrace -e 'usdt:./ffmpeg-demo:ffmpeg_demo:frame_decoded { @[arg1] = count(); }'
+ *
+ * Define FFMPEG_DEMO_NO_USDT, or build without systemtap headers, to drop them.
+ */
+#if !defined(FFMPEG_DEMO_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define FFMPEG_DEMO_USDT 1
+#endif
+#endif
+
+#ifdef FFMPEG_DEMO_USDT
+/* pts in microseconds, sizes in pixels or bytes */
+#define PROBE_FRAME_DECODED(pts, width, height) DTRACE_PROBE3(ffmpeg_demo, frame_decoded, pts, width, height)
+#define PROBE_FRAME_CONVERTED(pts, bytes) DTRACE_PROBE2(ffmpeg_demo, frame_converted, pts, bytes)
+#define PROBE_TEXTURE_UPLOADED(stream, pts, bytes) DTRACE_PROBE3(ffmpeg_demo, texture_uploaded, stream, pts, bytes)
+#define PROBE_FRAME_PRESENTED(frame) DTRACE_PROBE1(ffmpeg_demo, frame_presented, frame)
+/* stage is a Stage value */
+#define PROBE_FRAME_DROPPED(stage, pts) DTRACE_PROBE2(ffmpeg_demo, frame_dropped, stage, pts)
+#define PROBE_IMAGE_LOAD_ENTER(source, len) DTRACE_PROBE2(ffmpeg_demo, image_load_enter, source, len)
+#define PROBE_IMAGE_LOAD_EXIT(result, width, height, comp) \
+    DTRACE_PROBE4(ffmpeg_demo, image_load_exit, result, width, height, comp)
+#else
+#define PROBE_FRAME_DECODED(pts, width, height) do {} while (0)
+#define PROBE_FRAME_CONVERTED(pts, bytes) do {} while (0)
+#define PROBE_TEXTURE_UPLOADED(stream, pts, bytes) do {} while (0)
+#define PROBE_FRAME_PRESENTED(frame) do {} while (0)
+#define PROBE_FRAME_DROPPED(stage, pts) do {} while (0)
+#define PROBE_IMAGE_LOAD_ENTER(source, len) do {} while (0)
+#define PROBE_IMAGE_LOAD_EXIT(result, width, height, comp) do {} while (0)
+#endif
@@ -0,0 +1,241 @@
+#include "profiler.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+/* 128 linear buckets, then 64 sub-buckets per power of two up to about 68 s */
+constexpr int SubBucketBits = 7;
+constexpr int SubBucketCount = 1 << SubBucketBits;
+constexpr int SubBucketHalf = SubBucketCount / 2;
+constexpr int MaxValueBits = 36;
+constexpr uint64_t MaxValue = (1ull << MaxValueBits) - 1;
+constexpr int BucketCount = SubBucketCount + (MaxValueBits - SubBucketBits) * SubBucketHalf;
+
+int BucketIndex(uint64_t value) {
+    if (value > MaxValue)
+        value = MaxValue;
+    if (value < SubBucketCount)
+        return (int)value;
+    int shift = std::bit_width(value) - SubBucketBits;
+    return SubBucketCount + (shift - 1) * SubBucketHalf + (int)(value >> shift) - SubBucketHalf;
+}
+
+void BucketRange(int index, uint64_t* low, uint64_t* width) {
+    if (index < SubBucketCount) {
+        *low = index;
+        *width = 1;
+        return;
+    }
+    int shift = (index - SubBucketCount) / SubBucketHalf + 1;
+    *low = (uint64_t)((index - SubBucketCount) % SubBucketHalf + SubBucketHalf) << shift;
+    *width = 1ull << shift;
+}
+
+/* Written by its owning thread only, so updates are a load and a store */
+struct ThreadHistograms {
+    std::atomic<uint64_t> buckets[StageCount][BucketCount];
+    std::atomic<uint64_t> sum[StageCount];
+    std::atomic<uint64_t> max[StageCount];
+    std::atomic<uint64_t> drops[StageCount];
+    std::atomic<uint64_t> counterSamples[StageCount];
+    std::atomic<uint64_t> counters[StageCount][PerfCounterCount];
+
+    /* Open Begin/End intervals, only touched by the owning thread */
+    std::chrono::steady_clock::time_point openStart[StageCount];
+    PerfSample openCounters[StageCount];
+    bool openCounting[StageCount];
+};
+
+void Bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/* Histograms outlive their threads so nothing recorded by a finished worker is lost */
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadHistograms>> registry;
+
+ThreadHistograms& LocalHistograms() {
+    thread_local ThreadHistograms* local = nullptr;
+    if (!local) {
+        auto histograms = std::make_unique<ThreadHistograms>();
+        for (int s = 0; s < StageCount; s++) {
+            for (int b = 0; b < BucketCount; b++)
+                histograms->buckets[s][b].store(0, std::memory_order_relaxed);
+            histograms->sum[s].store(0, std::memory_order_relaxed);
+            histograms->max[s].store(0, std::memory_order_relaxed);
+            histograms->drops[s].store(0, std::memory_order_relaxed);
+            histograms->counterSamples[s].store(0, std::memory_order_relaxed);
+            for (int c = 0; c < PerfCounterCount; c++)
+                histograms->counters[s][c].store(0, std::memory_order_relaxed);
+        }
+        local = histograms.get();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::move(histograms));
+    }
+    return *local;
+}
+
+double Percentile(const std::vector<uint64_t>& buckets, uint64_t count, double fraction, uint64_t max) {
+    uint64_t target = (uint64_t)(fraction * count + 0.5);
+    if (target < 1)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < BucketCount; b++) {
+        seen += buckets[b];
+        if (seen >= target) {
+            uint64_t low, width;
+            BucketRange(b, &low, &width);
+            uint64_t mid = low + width / 2;
+            return (mid < max ? mid : max) / 1000.0;
+        }
+    }
+    return max / 1000.0;
+}
+
+}
+
+const char* Profiler::StageName(Stage stage) {
+    switch (stage) {
+    case Stage::Demux: return "demux";
+    case Stage::Decode: return "decode";
+    case Stage::Convert: return "convert";
+    case Stage::Upload: return "upload";
+    case Stage::Draw: return "draw";
+    case Stage::Capture: return "capture";
+    case Stage::Swap: return "swap";
+    case Stage::ImageDecode: return "image_decode";
+    case Stage::Overlay: return "overlay";
+    case Stage::GpuUpload: return "gpu_upload";
+    case Stage::GpuDraw: return "gpu_draw";
+    default: return "unknown";
+    }
+}
+
+void Profiler::Record(Stage stage, uint64_t nanoseconds, const PerfSample* counters) {
+    ThreadHistograms& local = LocalHistograms();
+    const int s = (int)stage;
+    Bump(local.buckets[s][BucketIndex(nanoseconds)], 1);
+    Bump(local.sum[s], nanoseconds);
+    if (nanoseconds > local.max[s].load(std::memory_order_relaxed))
+        local.max[s].store(nanoseconds, std::memory_order_relaxed);
+
+    if (counters) {
+        Bump(local.counterSamples[s], 1);
+        for (int c = 0; c < PerfCounterCount; c++)
+            Bump(local.counters[s][c], counters->values[c]);
+    }
+}
+
+void Profiler::Begin(Stage stage) {
+    ThreadHistograms& local = LocalHistograms();
+    const int s = (int)stage;
+    local.openCounting[s] = PerfCounters::Read(&local.openCounters[s]);
+    local.openStart[s] = std::chrono::steady_clock::now();
+}
+
+void Profiler::End(Stage stage) {
+    auto now = std::chrono::steady_clock::now();
+    ThreadHistograms& local = LocalHistograms();
+    const int s = (int)stage;
+
+    PerfSample delta;
+    bool counting = local.openCounting[s] && PerfCounters::Read(&delta);
+    if (counting) {
+        for (int c = 0; c < PerfCounterCount; c++)
+            delta.values[c] -= local.openCounters[s].values[c];
+    }
+    Record(stage, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - local.openStart[s]).count(),
+           counting ? &delta : nullptr);
+}
+
+void Profiler::RecordDrop(Stage stage) {
+    Bump(LocalHistograms().drops[(int)stage], 1);
+}
+
+void Profiler::Snapshot(StageSummary (&summary)[StageCount]) {
+    std::vector<uint64_t> merged(BucketCount);
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (int s = 0; s < StageCount; s++) {
+        std::fill(merged.begin(), merged.end(), 0);
+        uint64_t count = 0, sum = 0, max = 0, drops = 0, counterSamples = 0;
+        uint64_t counters[PerfCounterCount] = {};
+
+        for (auto& histograms : registry) {
+            for (int b = 0; b < BucketCount; b++) {
+                uint64_t n = histograms->buckets[s][b].load(std::memory_order_relaxed);
+                merged[b] += n;
+                count += n;
+            }
+            sum += histograms->sum[s].load(std::memory_order_relaxed);
+            drops += histograms->drops[s].load(std::memory_order_relaxed);
+            counterSamples += histograms->counterSamples[s].load(std::memory_order_relaxed);
+            for (int c = 0; c < PerfCounterCount; c++)
+                counters[c] += histograms->counters[s][c].load(std::memory_order_relaxed);
+            uint64_t threadMax = histograms->max[s].load(std::memory_order_relaxed);
+            if (threadMax > max)
+                max = threadMax;
+        }
+
+        StageSummary& out = summary[s];
+        out = StageSummary();
+        out.count = count;
+        out.drops = drops;
+        out.counterSamples = counterSamples;
+        for (int c = 0; c < PerfCounterCount; c++)
+            out.counters[c] = counters[c];
+        if (!count)
+            continue;
+        out.mean = (double)sum / count / 1000.0;
+        out.p50 = Percentile(merged, count, 0.50, max);
+        out.p90 = Percentile(merged, count, 0.90, max);
+        out.p99 = Percentile(merged, count, 0.99, max);
+        out.max = max / 1000.0;
+    }
+}
+
+bool Profiler::WriteSummary(const char* path) {
+    StageSummary summary[StageCount];
+    Snapshot(summary);
+
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Couldn't write profile summary to %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "{\n  \"unit\": \"us\",\n  \"stages\": {\n");
+    for (int s = 0; s < StageCount; s++) {
+        const StageSummary& stage = summary[s];
+        fprintf(file,
+                "    \"%s\": { \"count\": %llu, \"drops\": %llu, \"mean\": %.3f, "
+                "\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f",
+                StageName((Stage)s), (unsigned long long)stage.count, (unsigned long long)stage.drops,
+                stage.mean, stage.p50, stage.p90, stage.p99, stage.max);
+
+        if (stage.counterSamples) {
+            fprintf(file, ", \"counter_samples\": %llu", (unsigned long long)stage.counterSamples);
+            for (int c = 0; c < PerfCounterCount; c++)
+                fprintf(file, ", \"%s\": %llu", PerfCounters::Name((PerfCounter)c), (unsigned long long)stage.counters[c]);
+
+            /* Low IPC with many LLC misses per kilo-instruction points at memory, not arithmetic */
+            const double cycles = (double)stage.counters[(int)PerfCounter::Cycles];
+            const double instructions = (double)stage.counters[(int)PerfCounter::Instructions];
+            fprintf(file, ", \"ipc\": %.3f, \"llc_mpki\": %.3f",
+                    cycles > 0 ? instructions / cycles : 0.0,
+                    instructions > 0 ? stage.counters[(int)PerfCounter::CacheMisses] * 1000.0 / instructions : 0.0);
+        }
+        fprintf(file, " }%s\n", s + 1 < StageCount ? "," : "");
+    }
+    fprintf(file, "  }\n}\n");
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+
+#include "perf_counters.h"
+
+/*
+ * Per-stage latency histograms. Every thread records into its own
+ * log-linear histogram (about 1.5% resolution) with plain relaxed stores,
+ * readers merge all of them on demand. When PerfCounters are enabled each
+ * sample also carries the thread's hardware counter deltas, summed per
+ * stage next to the wall times. With FFMPEG_DEMO_PROFILE off the
+ * macros below expand to nothing, so release builds carry no timers.
+ */
+#ifndef FFMPEG_DEMO_PROFILE
+#define FFMPEG_DEMO_PROFILE 0
+#endif
+
+enum class Stage {
+    Demux,
+    Decode,
+    Convert,
+    Upload,
+    Draw,
+    Capture,
+    Swap,
+    ImageDecode,    // stb_image loads, through STBI_DECODE_BEGIN/END
+    Overlay,        // drawing the HUD, so its own cost stays visible
+    GpuUpload,      // GPU time of texture transfers, from GpuTimers
+    GpuDraw,        // GPU time of the scene draw, from GpuTimers
+    Count
+};
+
+constexpr int StageCount = (int)Stage::Count;
+
+/* Times in microseconds */
+struct StageSummary {
+    uint64_t count = 0;
+    uint64_t drops = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+    /* Totals over the samples that carried counters */
+    uint64_t counterSamples = 0;
+    uint64_t counters[PerfCounterCount] = {};
+};
+
+namespace Profiler {
+    const char* StageName(Stage stage);
+
+    void Record(Stage stage, uint64_t nanoseconds, const PerfSample* counters = nullptr);
+    void RecordDrop(Stage stage);
+
+    /* Unscoped timing for hooks that can't hold an object, must not nest per stage and thread */
+    void Begin(Stage stage);
+    void End(Stage stage);
+
+    /* Merges every thread's histograms, safe to call while others record */
+    void Snapshot(StageSummary (&summary)[StageCount]);
+    bool WriteSummary(const char* path);
+}
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Stage stage) : stage(stage) {
+        counting = PerfCounters::Read(&startCounters);
+        start = std::chrono::steady_clock::now();
+    }
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        PerfSample delta;
+        if (counting && PerfCounters::Read(&delta)) {
+            for (int i = 0; i < PerfCounterCount; i++)
+                delta.values[i] -= startCounters.values[i];
+        } else {
+            counting = false;
+        }
+        Profiler::Record(stage, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                         counting ? &delta : nullptr);
+    }
+
+private:
+    Stage stage;
+    bool counting;
+    PerfSample startCounters;
+    std::chrono::steady_clock::time_point start;
+};
+
+/* Adds up several disjoint intervals and records them as one sample */
+class StageAccumulator {
+public:
+    explicit StageAccumulator(Stage stage) : stage(stage) {}
+    ~StageAccumulator() {
+        if (used)
+            Profiler::Record(stage, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(total).count(),
+                             counting ? &counters : nullptr);
+    }
+
+    void Begin() {
+        counting = PerfCounters::Read(&startCounters);
+        start = std::chrono::steady_clock::now();
+    }
+    void End() {
+        total += std::chrono::steady_clock::now() - start;
+        PerfSample now;
+        if (counting && PerfCounters::Read(&now)) {
+            for (int i = 0; i < PerfCounterCount; i++)
+                counters.values[i] += now.values[i] - startCounters.values[i];
+        }
+        used = true;
+    }
+
+private:
+    Stage stage;
+    bool used = false;
+    bool counting = false;
+    PerfSample startCounters;
+    PerfSample counters;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::duration total{};
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if FFMPEG_DEMO_PROFILE
+#define PROFILE_SCOPE(stage) ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(stage)
+#define PROFILE_ACCUMULATOR(name, stage) StageAccumulator name(stage)
+#define PROFILE_BEGIN(name) name.Begin()
+#define PROFILE_END(name) name.End()
+#define PROFILE_DROP(stage) Profiler::RecordDrop(stage)
+#define PROFILE_STAGE_BEGIN(stage) Profiler::Begin(stage)
+#define PROFILE_STAGE_END(stage) Profiler::End(stage)
+#else
+#define PROFILE_SCOPE(stage) do {} while (0)
+#define PROFILE_ACCUMULATOR(name, stage) do {} while (0)
+#define PROFILE_BEGIN(name) do {} while (0)
+#define PROFILE_END(name) do {} while (0)
+#define PROFILE_DROP(stage) do {} while (0)
+#define PROFILE_STAGE_BEGIN(stage) do {} while (0)
+#define PROFILE_STAGE_END(stage) do {} while (0)
+#endif
@@ -0,0 +1,332 @@
+#include "recorder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "probes.h"
+#include "profiler.h"
+#include "tracer.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+Recorder::~Recorder() {
+    Close();
+}
+
+bool Recorder::Open(const RecorderSettings& recorderSettings) {
+    settings = recorderSettings;
+    if (settings.width <= 0 || settings.height <= 0 || settings.queueDepth <= 0) {
+        printf("Recorder: invalid capture size\n");
+        return false;
+    }
+
+    avformat_alloc_output_context2(&formatCtx, NULL, NULL, settings.filename);
+    if (!formatCtx) {
+        printf("Recorder: couldn't guess output format for %s\n", settings.filename);
+        return false;
+    }
+
+    const AVCodec* codec = avcodec_find_encoder(formatCtx->oformat->video_codec);
+    if (!codec) {
+        printf("Recorder: no video encoder for %s\n", settings.filename);
+        Close();
+        return false;
+    }
+
+    codecCtx = avcodec_alloc_context3(codec);
+    if (!codecCtx) {
+        printf("Recorder: couldn't allocate encoder %s\n", codec->name);
+        Close();
+        return false;
+    }
+    codecCtx->width = settings.width;
+    codecCtx->height = settings.height;
+    codecCtx->pix_fmt = AV_PIX_FMT_YUV420P;
+    codecCtx->time_base = AVRational{1, settings.frameRate};
+    codecCtx->framerate = AVRational{settings.frameRate, 1};
+    codecCtx->gop_size = settings.frameRate;
+    codecCtx->bit_rate = settings.bitRate;
+    codecCtx->thread_count = settings.threadCount;
+    codecCtx->thread_type = FF_THREAD_FRAME;
+    if (formatCtx->oformat->flags & AVFMT_GLOBALHEADER)
+        codecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    if (avcodec_open2(codecCtx, codec, NULL) < 0) {
+        printf("Recorder: couldn't open encoder %s\n", codec->name);
+        Close();
+        return false;
+    }
+
+    stream = avformat_new_stream(formatCtx, NULL);
+    if (!stream) {
+        printf("Recorder: couldn't add a stream to %s\n", settings.filename);
+        Close();
+        return false;
+    }
+    stream->time_base = codecCtx->time_base;
+    avcodec_parameters_from_context(stream->codecpar, codecCtx);
+
+    if (!(formatCtx->oformat->flags & AVFMT_NOFILE) &&
+        avio_open(&formatCtx->pb, settings.filename, AVIO_FLAG_WRITE) < 0) {
+        printf("Recorder: couldn't open %s for writing\n", settings.filename);
+        Close();
+        return false;
+    }
+
+    if (avformat_write_header(formatCtx, NULL) < 0) {
+        printf("Recorder: couldn't write header\n");
+        Close();
+        return false;
+    }
+
+    frame = av_frame_alloc();
+    packet = av_packet_alloc();
+    if (!frame || !packet) {
+        printf("Recorder: couldn't allocate a frame\n");
+        Close();
+        return false;
+    }
+    frame->format = codecCtx->pix_fmt;
+    frame->width = settings.width;
+    frame->height = settings.height;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        printf("Recorder: couldn't allocate a %dx%d frame\n", settings.width, settings.height);
+        Close();
+        return false;
+    }
+
+    swsCtx = sws_getContext(settings.width, settings.height, AV_PIX_FMT_RGB24,
+                            settings.width, settings.height, codecCtx->pix_fmt,
+                            SWS_BILINEAR, NULL, NULL, NULL);
+    if (!swsCtx) {
+        printf("Recorder: couldn't create the RGB to YUV converter\n");
+        Close();
+        return false;
+    }
+
+    /* Every capture buffer is allocated up front, the render loop never allocates */
+    slots.resize(settings.queueDepth);
+    for (int i = 0; i < settings.queueDepth; i++) {
+        slots[i].pixels.resize((size_t)settings.width * settings.height * 3);
+        freeSlots.push_back(i);
+    }
+
+    /* Without pixel buffers every capture reads straight into a slot and waits for the GPU */
+    if (glExt.asyncUpload) {
+        const GLsizeiptr size = (GLsizeiptr)settings.width * settings.height * 3;
+        for (Readback& readback : readbacks) {
+            glExt.GenBuffers(1, &readback.pbo);
+            glExt.BindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+            glExt.BufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+            readbackBytes.Add(size);
+        }
+        glExt.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    firstReadback = 0;
+    pendingReadbacks = 0;
+    resized = false;
+
+    stopping = false;
+    encoder = std::thread(&Recorder::EncoderLoop, this);
+    return true;
+}
+
+void Recorder::Close() {
+    /* Every presented frame that was read back still goes to the file */
+    while (pendingReadbacks > 0)
+        FinishReadback(true);
+    for (Readback& readback : readbacks) {
+        if (readback.pbo)
+            glExt.DeleteBuffers(1, &readback.pbo);
+        readback.pbo = 0;
+    }
+    readbackBytes.Set(0);
+
+    if (encoder.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        slotReady.notify_all();
+        encoder.join();
+
+        /* Drain the frames still buffered inside the encoder */
+        EncodeFrame(nullptr);
+        av_write_trailer(formatCtx);
+    }
+
+    if (formatCtx && !(formatCtx->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&formatCtx->pb);
+
+    sws_freeContext(swsCtx);
+    swsCtx = nullptr;
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&codecCtx);
+    avformat_free_context(formatCtx);
+    formatCtx = nullptr;
+    stream = nullptr;
+
+    slots.clear();
+    freeSlots.clear();
+    readySlots.clear();
+}
+
+bool Recorder::CaptureFramebuffer(int width, int height) {
+    if (!IsOpen() || resized)
+        return false;
+    if (width != settings.width || height != settings.height) {
+        /* The encoder and the slots are sized for the first framebuffer */
+        printf("Recorder: framebuffer resized to %dx%d, recording stopped\n", width, height);
+        resized = true;
+        return false;
+    }
+
+    PROFILE_SCOPE(Stage::Capture);
+    int64_t index = framesPresented++;
+    const bool wait = settings.policy == RecordPolicy::Block;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    if (!readbacks[0].pbo) {
+        int slot = AcquireSlot(index, wait);
+        if (slot < 0)
+            return false;
+        glReadPixels(0, 0, settings.width, settings.height, GL_RGB, GL_UNSIGNED_BYTE, slots[slot].pixels.data());
+        QueueSlot(slot, index);
+        return true;
+    }
+
+    /* Readbacks the GPU already finished go to the encoder, oldest first */
+    while (pendingReadbacks > 0 && FinishReadback(false)) {
+    }
+    if (pendingReadbacks == ReadbackCount) {
+        if (!wait) {
+            framesDropped++;
+            PROFILE_DROP(Stage::Capture);
+            PROBE_FRAME_DROPPED((int)Stage::Capture, index);
+            return false;
+        }
+        FinishReadback(true);
+    }
+
+    Readback& readback = readbacks[(firstReadback + pendingReadbacks) % ReadbackCount];
+    glExt.BindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glReadPixels(0, 0, settings.width, settings.height, GL_RGB, GL_UNSIGNED_BYTE, (void*)0);
+    glExt.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glExt.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.index = index;
+    pendingReadbacks++;
+    return true;
+}
+
+/* Copies the oldest readback into a slot for the encoder, false while the GPU is still writing it */
+bool Recorder::FinishReadback(bool wait) {
+    Readback& readback = readbacks[firstReadback];
+    GLenum status = glExt.ClientWaitSync(readback.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                         wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glExt.DeleteSync(readback.fence);
+    readback.fence = nullptr;
+    firstReadback = (firstReadback + 1) % ReadbackCount;
+    pendingReadbacks--;
+
+    /* Closing drains every readback regardless of the policy */
+    int slot = AcquireSlot(readback.index, wait || settings.policy == RecordPolicy::Block);
+    if (slot < 0)
+        return true;
+
+    const size_t size = (size_t)settings.width * settings.height * 3;
+    glExt.BindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    void* mapped = glExt.MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)size, GL_MAP_READ_BIT);
+    if (mapped) {
+        memcpy(slots[slot].pixels.data(), mapped, size);
+        glExt.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glExt.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    QueueSlot(slot, readback.index);
+    return true;
+}
+
+/* A free capture slot, or -1 after counting the frame as dropped */
+int Recorder::AcquireSlot(int64_t index, bool wait) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (freeSlots.empty()) {
+        if (!wait) {
+            framesDropped++;
+            PROFILE_DROP(Stage::Capture);
+            PROBE_FRAME_DROPPED((int)Stage::Capture, index);
+            return -1;
+        }
+        slotFreed.wait(lock, [this] { return !freeSlots.empty(); });
+    }
+    int slot = freeSlots.back();
+    freeSlots.pop_back();
+    return slot;
+}
+
+void Recorder::QueueSlot(int slot, int64_t index) {
+    slots[slot].index = index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        readySlots.push_back(slot);
+    }
+    slotReady.notify_one();
+}
+
+int Recorder::QueuedFrames() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)readySlots.size();
+}
+
+void Recorder::EncoderLoop() {
+    TRACE_THREAD_NAME("encoder");
+    const int stride = settings.width * 3;
+
+    for (;;) {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            slotReady.wait(lock, [this] { return stopping || !readySlots.empty(); });
+            if (readySlots.empty())
+                return;
+            slot = readySlots.front();
+            readySlots.pop_front();
+        }
+
+        /* GL rows start at the bottom, walk the capture upwards to flip it */
+        const uint8_t* src[1] = { slots[slot].pixels.data() + (size_t)(settings.height - 1) * stride };
+        const int srcStride[1] = { -stride };
+
+        if (av_frame_make_writable(frame) >= 0) {
+            TRACE_SCOPE("encode", slots[slot].index, -1);
+            sws_scale(swsCtx, src, srcStride, 0, settings.height, frame->data, frame->linesize);
+            frame->pts = slots[slot].index;
+            if (EncodeFrame(frame))
+                framesEncoded++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeSlots.push_back(slot);
+        }
+        slotFreed.notify_one();
+    }
+}
+
+bool Recorder::EncodeFrame(AVFrame* input) {
+    if (avcodec_send_frame(codecCtx, input) < 0)
+        return false;
+
+    int ret;
+    while ((ret = avcodec_receive_packet(codecCtx, packet)) >= 0) {
+        av_packet_rescale_ts(packet, codecCtx->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+        av_interleaved_write_frame(formatCtx, packet);
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gl_ext.h"
+#include "memory_stats.h"
+
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct AVStream;
+struct SwsContext;
+
+enum class RecordPolicy {
+    Drop,   // skip the frame when every slot is busy, the render loop never waits
+    Block,  // wait for a free slot so every presented frame reaches the file
+};
+
+struct RecorderSettings {
+    const char* filename = "capture.mp4";
+    int width = 0;
+    int height = 0;
+    int frameRate = 60;
+    int64_t bitRate = 8000000;
+    int threadCount = 0;    // encoder frame threads, 0 lets libavcodec decide
+    int queueDepth = 4;     // captured frames waiting for the encoder
+    RecordPolicy policy = RecordPolicy::Drop;
+};
+
+/*
+ * Encodes presented frames to a video file. The render thread only starts an
+ * asynchronous readback into a pixel buffer and, a couple of frames later,
+ * copies the finished one into a preallocated slot; color conversion,
+ * encoding and muxing happen on a background thread feeding a frame-threaded
+ * libavcodec encoder.
+ */
+class Recorder {
+public:
+    Recorder() = default;
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+    ~Recorder();
+
+    bool Open(const RecorderSettings& settings);
+    /* Finishes the readbacks in flight, needs the context that captured current */
+    void Close();
+    bool IsOpen() const { return formatCtx != nullptr; }
+
+    /*
+     * Starts reading the current back buffer of the given size, call before
+     * swapping. Recording stops once the size no longer matches the one the
+     * recorder was opened with.
+     */
+    bool CaptureFramebuffer(int width, int height);
+
+    /* Captured frames waiting for the encoder */
+    int QueuedFrames();
+
+    uint64_t FramesEncoded() const { return framesEncoded.load(); }
+    uint64_t FramesDropped() const { return framesDropped.load(); }
+
+private:
+    struct Slot {
+        std::vector<unsigned char, TrackedAllocator<unsigned char, MemoryCategory::Capture>> pixels;
+        int64_t index = 0;
+    };
+
+    /* Readbacks in flight on the GPU, oldest first */
+    struct Readback {
+        GLuint pbo = 0;
+        GLsync fence = nullptr;
+        int64_t index = 0;
+    };
+    static constexpr int ReadbackCount = 3;
+
+    bool FinishReadback(bool wait);
+    int AcquireSlot(int64_t index, bool wait);
+    void QueueSlot(int slot, int64_t index);
+    void EncoderLoop();
+    bool EncodeFrame(AVFrame* frame);
+
+    RecorderSettings settings;
+
+    AVFormatContext* formatCtx = nullptr;
+    AVCodecContext* codecCtx = nullptr;
+    AVStream* stream = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;
+    SwsContext* swsCtx = nullptr;
+
+    Readback readbacks[ReadbackCount];
+    int firstReadback = 0;
+    int pendingReadbacks = 0;
+    MemoryCharge readbackBytes{MemoryCategory::Capture};
+    bool resized = false;
+
+    std::vector<Slot> slots;
+    std::vector<int> freeSlots;
+    std::deque<int> readySlots;
+    std::mutex mutex;
+    std::condition_variable slotFreed;
+    std::condition_variable slotReady;
+    bool stopping = false;
+    std::thread encoder;
+
+    int64_t framesPresented = 0;
+    std::atomic<uint64_t> framesEncoded{0};
+    std::atomic<uint64_t> framesDropped{0};
+};
@@ -0,0 +1,22 @@
+/* The one translation unit holding stb_image, shared by every target through the core library */
+#include "memory_stats.h"
+#include "probes.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+/* stb_image loads show up as their own profiler stage and as tracepoints */
+#define STBI_DECODE_BEGIN() PROFILE_STAGE_BEGIN(Stage::ImageDecode)
+#define STBI_DECODE_END() PROFILE_STAGE_END(Stage::ImageDecode)
+#define STBI_LOAD_ENTER(source, len) PROBE_IMAGE_LOAD_ENTER(source, len)
+#define STBI_LOAD_EXIT(result, w, h, comp) PROBE_IMAGE_LOAD_EXIT(result, w, h, comp)
+/* ...and every byte it allocates is accounted for */
+#define STBI_MALLOC(size) MemoryStats::StbMalloc(size)
+#define STBI_REALLOC(pointer, size) MemoryStats::StbRealloc(pointer, size)
+#define STBI_FREE(pointer) MemoryStats::StbFree(pointer)
+/* Large JPEGs spread their work over the shared decode pool, so loads during playback add no threads */
+static void StbParallelFor(int count, void (*func)(void*, int), void* context) {
+    ThreadPool::Shared().ParallelFor(count, [func, context](int i) { func(context, i); });
+}
+#define STBI_PARALLEL_FOR(count, func, context) StbParallelFor(count, func, context)
+#define STB_IMAGE_IMPLEMENTATION
+#include "../lib/stb/stb_image.h"
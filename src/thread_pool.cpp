@@ -0,0 +1,119 @@
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "tracer.h"
+
+static std::atomic<int> sharedThreadCount{0};
+
+ThreadPool& ThreadPool::Shared() {
+    static ThreadPool pool(sharedThreadCount.load());
+    return pool;
+}
+
+void ThreadPool::SetSharedThreadCount(int threadCount) {
+    sharedThreadCount.store(threadCount);
+}
+
+ThreadPool::ThreadPool(int threadCount) {
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount <= 0)
+        threadCount = 1;
+
+    for (int i = 0; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskQueued.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    taskQueued.notify_one();
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return tasks.empty() && running == 0; });
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& body) {
+    struct Batch {
+        std::atomic<int> next{0};
+        std::atomic<int> done{0};
+        int count = 0;
+        const std::function<void(int)>* body = nullptr;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    if (count <= 0)
+        return;
+
+    /* Helpers that start after the last index was taken find nothing to do and never touch body */
+    auto batch = std::make_shared<Batch>();
+    batch->count = count;
+    batch->body = &body;
+    auto work = [batch] {
+        for (int i = batch->next++; i < batch->count; i = batch->next++) {
+            (*batch->body)(i);
+            if (++batch->done == batch->count) {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->finished.notify_all();
+            }
+        }
+    };
+
+    int helpers = std::min(count - 1, ThreadCount());
+    for (int i = 0; i < helpers; i++)
+        Submit(work);
+    work();
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->finished.wait(lock, [&] { return batch->done.load() == count; });
+}
+
+void ThreadPool::WorkerLoop(int index) {
+#if FFMPEG_DEMO_TRACE
+    char name[32];
+    snprintf(name, sizeof(name), "worker-%d", index);
+    Tracer::SetThreadName(name);
+#else
+    (void)index;
+#endif
+
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskQueued.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            running++;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+            if (tasks.empty() && running == 0)
+                idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads shared by everything that decodes. Sizing it
+ * once keeps the total thread count bounded no matter how many streams run;
+ * Shared() is that one pool for the whole process, used by the video wall
+ * and by stb_image's parallel JPEG loops alike.
+ */
+class ThreadPool {
+public:
+    /* 0 uses one worker per hardware thread */
+    explicit ThreadPool(int threadCount = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    /* Finishes the queued tasks before joining */
+    ~ThreadPool();
+
+    void Submit(std::function<void()> task);
+    /* Blocks until the queue is empty and no task is running */
+    void Wait();
+    /*
+     * Runs body(0..count-1) on the workers and the calling thread, returning
+     * once every index is done. The caller works through indices itself, so
+     * it finishes even when called from a worker with the pool busy.
+     */
+    void ParallelFor(int count, const std::function<void(int)>& body);
+
+    int ThreadCount() const { return (int)workers.size(); }
+
+    /* Created on first use, sized by the last SetSharedThreadCount before that */
+    static ThreadPool& Shared();
+    /* 0 uses one worker per hardware thread, ignored once the shared pool exists */
+    static void SetSharedThreadCount(int threadCount);
+
+private:
+    void WorkerLoop(int index);
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskQueued;
+    std::condition_variable idle;
+    int running = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,242 @@
+#include "tile_renderer.h"
+
+#include <stdio.h>
+
+static const char* tileVertexShader = R"(#version 330
+layout(location = 0) in vec2 corner;
+layout(location = 1) in vec4 rect;
+layout(location = 2) in float layer;
+uniform vec2 viewport;
+out vec3 uv;
+void main() {
+    vec2 position = rect.xy + corner * rect.zw;
+    gl_Position = vec4(position / viewport * 2.0 - 1.0, 0.0, 1.0);
+    uv = vec3(corner.x, 1.0 - corner.y, layer);
+}
+)";
+
+static const char* tileFragmentShader = R"(#version 330
+uniform sampler2DArray frames;
+in vec3 uv;
+out vec4 color;
+void main() {
+    color = texture(frames, uv);
+}
+)";
+
+static const int instanceFloats = 5;
+
+static GLuint CompileShader(GLenum type, const char* source) {
+    GLuint shader = glExt.CreateShader(type);
+    glExt.ShaderSource(shader, 1, &source, NULL);
+    glExt.CompileShader(shader);
+
+    GLint ok = GL_FALSE;
+    glExt.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glExt.GetShaderInfoLog(shader, sizeof(log), NULL, log);
+        printf("Tile shader: %s\n", log);
+        glExt.DeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+TileRenderer::~TileRenderer() {
+    Shutdown();
+}
+
+bool TileRenderer::Init() {
+    if (!glExt.instancedTiles)
+        return false;
+
+    GLuint vertex = CompileShader(GL_VERTEX_SHADER, tileVertexShader);
+    GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, tileFragmentShader);
+    if (!vertex || !fragment) {
+        if (vertex)
+            glExt.DeleteShader(vertex);
+        if (fragment)
+            glExt.DeleteShader(fragment);
+        return false;
+    }
+
+    program = glExt.CreateProgram();
+    glExt.AttachShader(program, vertex);
+    glExt.AttachShader(program, fragment);
+    glExt.LinkProgram(program);
+    glExt.DeleteShader(vertex);
+    glExt.DeleteShader(fragment);
+
+    GLint ok = GL_FALSE;
+    glExt.GetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glExt.GetProgramInfoLog(program, sizeof(log), NULL, log);
+        printf("Tile program: %s\n", log);
+        glExt.DeleteProgram(program);
+        program = 0;
+        return false;
+    }
+
+    glExt.UseProgram(program);
+    glExt.Uniform1i(glExt.GetUniformLocation(program, "frames"), 0);
+    viewportLocation = glExt.GetUniformLocation(program, "viewport");
+    glExt.UseProgram(0);
+
+    static const float corners[] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+    glExt.GenBuffers(1, &cornerBuffer);
+    glExt.BindBuffer(GL_ARRAY_BUFFER, cornerBuffer);
+    glExt.BufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glExt.GenBuffers(1, &instanceBuffer);
+    glExt.BindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void TileRenderer::Shutdown() {
+    for (Group& group : groups) {
+        if (group.array)
+            glDeleteTextures(1, &group.array);
+    }
+    groups.clear();
+    tiles.clear();
+    textureBytes.Set(0);
+
+    if (cornerBuffer)
+        glExt.DeleteBuffers(1, &cornerBuffer);
+    if (instanceBuffer)
+        glExt.DeleteBuffers(1, &instanceBuffer);
+    if (program)
+        glExt.DeleteProgram(program);
+    cornerBuffer = instanceBuffer = program = 0;
+}
+
+int TileRenderer::AddTile(int width, int height) {
+    int groupIndex = -1;
+    for (size_t i = 0; i < groups.size(); i++) {
+        if (groups[i].width == width && groups[i].height == height) {
+            groupIndex = (int)i;
+            break;
+        }
+    }
+    if (groupIndex < 0) {
+        groups.emplace_back();
+        groups.back().width = width;
+        groups.back().height = height;
+        groupIndex = (int)groups.size() - 1;
+    }
+
+    Tile tile;
+    tile.group = groupIndex;
+    tile.layer = (int)groups[groupIndex].tiles.size();
+    tiles.push_back(tile);
+    groups[groupIndex].tiles.push_back((int)tiles.size() - 1);
+    return (int)tiles.size() - 1;
+}
+
+void TileRenderer::Build() {
+    for (Group& group : groups) {
+        if (group.array)
+            continue;
+        glGenTextures(1, &group.array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, group.array);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glExt.TexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, group.width, group.height, (GLsizei)group.tiles.size(),
+                         0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        textureBytes.Add(MemoryStats::TextureBytes(group.width, group.height, (int)group.tiles.size()));
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    instances.reserve(tiles.size() * instanceFloats);
+}
+
+void TileRenderer::UpdateFromPixels(int id, const unsigned char* rgb) {
+    Tile& tile = tiles[id];
+    const Group& group = groups[tile.group];
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, group.array);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glExt.TexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, tile.layer, group.width, group.height, 1,
+                        GL_RGB, GL_UNSIGNED_BYTE, rgb);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    tile.hasContent = true;
+}
+
+void TileRenderer::UpdateFromTexture(int id, GLuint texture) {
+    Tile& tile = tiles[id];
+    const Group& group = groups[tile.group];
+
+    /* GPU side copy, the pixels never come back to the CPU */
+    glExt.CopyImageSubData(texture, GL_TEXTURE_2D, 0, 0, 0, 0,
+                           group.array, GL_TEXTURE_2D_ARRAY, 0, 0, 0, tile.layer,
+                           group.width, group.height, 1);
+    tile.hasContent = true;
+}
+
+void TileRenderer::SetRect(int id, float x, float y, float width, float height) {
+    float* rect = tiles[id].rect;
+    rect[0] = x;
+    rect[1] = y;
+    rect[2] = width;
+    rect[3] = height;
+}
+
+void TileRenderer::Draw(int viewportWidth, int viewportHeight) {
+    /* Pack the visible tiles group by group so each group is a contiguous run of instances */
+    instances.clear();
+    std::vector<int> groupCounts(groups.size(), 0);
+    for (size_t g = 0; g < groups.size(); g++) {
+        for (int id : groups[g].tiles) {
+            const Tile& tile = tiles[id];
+            if (!tile.hasContent)
+                continue;
+            instances.insert(instances.end(), tile.rect, tile.rect + 4);
+            instances.push_back((float)tile.layer);
+            groupCounts[g]++;
+        }
+    }
+    if (instances.empty())
+        return;
+
+    glExt.BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glExt.BufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(float), instances.data(), GL_STREAM_DRAW);
+
+    glExt.UseProgram(program);
+    glExt.Uniform2f(viewportLocation, (float)viewportWidth, (float)viewportHeight);
+
+    glExt.BindBuffer(GL_ARRAY_BUFFER, cornerBuffer);
+    glExt.EnableVertexAttribArray(0);
+    glExt.VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (const void*)0);
+
+    glExt.BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glExt.EnableVertexAttribArray(1);
+    glExt.EnableVertexAttribArray(2);
+    glExt.VertexAttribDivisor(1, 1);
+    glExt.VertexAttribDivisor(2, 1);
+
+    const GLsizei stride = instanceFloats * sizeof(float);
+    size_t first = 0;
+    for (size_t g = 0; g < groups.size(); g++) {
+        if (!groupCounts[g])
+            continue;
+
+        const size_t offset = first * stride;
+        glExt.VertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (const void*)offset);
+        glExt.VertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (const void*)(offset + 4 * sizeof(float)));
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, groups[g].array);
+        glExt.DrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, groupCounts[g]);
+        first += groupCounts[g];
+    }
+
+    glExt.VertexAttribDivisor(1, 0);
+    glExt.VertexAttribDivisor(2, 0);
+    glExt.DisableVertexAttribArray(0);
+    glExt.DisableVertexAttribArray(1);
+    glExt.DisableVertexAttribArray(2);
+    glExt.BindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glExt.UseProgram(0);
+}
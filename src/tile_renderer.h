@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include "gl_ext.h"
+#include "memory_stats.h"
+
+/*
+ * Draws many video tiles with one instanced call per tile size. Tiles of the
+ * same size share a texture array, one layer each, and their screen rects
+ * live in an instance buffer, so a frame costs one bind and one draw per
+ * size no matter how many feeds are on screen.
+ */
+class TileRenderer {
+public:
+    TileRenderer() = default;
+    TileRenderer(const TileRenderer&) = delete;
+    TileRenderer& operator=(const TileRenderer&) = delete;
+    ~TileRenderer();
+
+    /* False when the context lacks shaders, texture arrays or instancing */
+    bool Init();
+    void Shutdown();
+
+    int AddTile(int width, int height);
+    /* Allocates one texture array per tile size, call after the last AddTile */
+    void Build();
+
+    /* Replace only the tile's own layer, either from client memory or from another texture */
+    void UpdateFromPixels(int tile, const unsigned char* rgb);
+    void UpdateFromTexture(int tile, GLuint texture);
+
+    /* Screen rect in pixels, origin at the bottom left */
+    void SetRect(int tile, float x, float y, float width, float height);
+
+    void Draw(int viewportWidth, int viewportHeight);
+
+private:
+    struct Group {
+        int width = 0;
+        int height = 0;
+        GLuint array = 0;
+        std::vector<int> tiles;
+    };
+
+    struct Tile {
+        int group = 0;
+        int layer = 0;
+        float rect[4] = {};
+        bool hasContent = false;
+    };
+
+    std::vector<Group> groups;
+    MemoryCharge textureBytes{MemoryCategory::Textures};
+    std::vector<Tile> tiles;
+    std::vector<float> instances;
+
+    GLuint program = 0;
+    GLint viewportLocation = -1;
+    GLuint cornerBuffer = 0;
+    GLuint instanceBuffer = 0;
+};
@@ -0,0 +1,120 @@
+#include "tracer.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+constexpr size_t RingSize = 1 << 15;
+
+struct Event {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+    int64_t frame;
+    int64_t pts;
+};
+
+/* Single writer: the owning thread fills a slot, then publishes it by bumping head */
+struct ThreadRing {
+    int tid = 0;
+    char name[32] = {};
+    std::atomic<uint64_t> head{0};
+    Event events[RingSize];
+};
+
+std::atomic<bool> enabled{false};
+const auto epoch = std::chrono::steady_clock::now();
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadRing>> registry;
+
+/* A ring is only allocated once its thread records an event, until then the name waits here */
+thread_local ThreadRing* localRing = nullptr;
+thread_local char localName[32] = {};
+
+ThreadRing& LocalRing() {
+    if (!localRing) {
+        auto ring = std::make_unique<ThreadRing>();
+        localRing = ring.get();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        ring->tid = (int)registry.size() + 1;
+        if (localName[0])
+            snprintf(ring->name, sizeof(ring->name), "%s", localName);
+        else
+            snprintf(ring->name, sizeof(ring->name), "thread-%d", ring->tid);
+        registry.push_back(std::move(ring));
+    }
+    return *localRing;
+}
+
+}
+
+void Tracer::Start() {
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+bool Tracer::IsEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t Tracer::Now() {
+    /* Never 0, TraceScope uses that to mean "not recording" */
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count() + 1;
+}
+
+void Tracer::SetThreadName(const char* name) {
+    snprintf(localName, sizeof(localName), "%s", name);
+    if (localRing) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        snprintf(localRing->name, sizeof(localRing->name), "%s", name);
+    }
+}
+
+void Tracer::Complete(const char* name, uint64_t startNs, uint64_t endNs, int64_t frame, int64_t pts) {
+    if (!IsEnabled())
+        return;
+
+    ThreadRing& ring = LocalRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    Event& event = ring.events[head % RingSize];
+    event.name = name;
+    event.start = startNs;
+    event.duration = endNs - startNs;
+    event.frame = frame;
+    event.pts = pts;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+bool Tracer::WriteTrace(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Couldn't write trace to %s\n", path);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (auto& ring : registry) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", ring->tid, ring->name);
+        first = false;
+
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = head > RingSize ? head - RingSize : 0;
+        for (uint64_t i = begin; i < head; i++) {
+            const Event& event = ring->events[i % RingSize];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                          "\"args\":{\"frame\":%lld,\"pts\":%lld}}",
+                    event.name, ring->tid, event.start / 1000.0, event.duration / 1000.0,
+                    (long long)event.frame, (long long)event.pts);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+
+/*
+ * Timeline of pipeline work in Chrome trace event format, readable in
+ * Perfetto or chrome://tracing. Each thread appends complete events (begin
+ * time plus duration, tagged with frame number and pts) to its own ring
+ * buffer; the oldest events are overwritten once it wraps. A frame or pts
+ * of -1 means it isn't known where the event is recorded. Builds without
+ * FFMPEG_DEMO_TRACE compile every macro below to nothing.
+ */
+#ifndef FFMPEG_DEMO_TRACE
+#define FFMPEG_DEMO_TRACE 0
+#endif
+
+namespace Tracer {
+    /* Recording stays off until Start, so a tracing build costs a flag test when unused */
+    void Start();
+    bool IsEnabled();
+
+    /* Cheap before Start, the thread's ring is allocated by its first event */
+    void SetThreadName(const char* name);
+    /* name must be a string literal or otherwise outlive the dump */
+    void Complete(const char* name, uint64_t startNs, uint64_t endNs, int64_t frame, int64_t pts);
+    uint64_t Now();
+
+    /* Writes every thread's buffered events, best taken once the workers are idle */
+    bool WriteTrace(const char* path);
+}
+
+class TraceScope {
+public:
+    TraceScope(const char* name, int64_t frame, int64_t pts)
+        : name(name), frame(frame), pts(pts), start(Tracer::IsEnabled() ? Tracer::Now() : 0) {}
+    ~TraceScope() {
+        if (start)
+            Tracer::Complete(name, start, Tracer::Now(), frame, pts);
+    }
+
+private:
+    const char* name;
+    int64_t frame;
+    int64_t pts;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if FFMPEG_DEMO_TRACE
+#define TRACE_SCOPE(name, frame, pts) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, frame, pts)
+/* For spans whose frame or pts is only known once the work is done */
+#define TRACE_MARK(var) uint64_t var = Tracer::IsEnabled() ? Tracer::Now() : 0
+#define TRACE_COMPLETE(name, var, frame, pts) \
+    do { if (var) Tracer::Complete(name, var, Tracer::Now(), frame, pts); } while (0)
+#define TRACE_THREAD_NAME(name) Tracer::SetThreadName(name)
+#else
+#define TRACE_SCOPE(name, frame, pts) do {} while (0)
+#define TRACE_MARK(var) do {} while (0)
+#define TRACE_COMPLETE(name, var, frame, pts) do {} while (0)
+#define TRACE_THREAD_NAME(name) do {} while (0)
+#endif
@@ -0,0 +1,259 @@
+#include "upload_thread.h"
+
+#include <string.h>
+
+#include "gpu_timers.h"
+#include "probes.h"
+#include "profiler.h"
+#include "tracer.h"
+
+UploadThread::~UploadThread() {
+    Stop();
+}
+
+bool UploadThread::Start(GLFWwindow* sharedWith) {
+    if (!glExt.asyncUpload)
+        return false;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context = glfwCreateWindow(1, 1, "upload", NULL, sharedWith);
+    glfwDefaultWindowHints();
+    if (!context)
+        return false;
+
+    stopping = false;
+    worker = std::thread(&UploadThread::UploadLoop, this);
+    return true;
+}
+
+void UploadThread::Stop() {
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+    /* Textures, buffers and fences are shared, so the main context can free them */
+    for (auto& stream : streams) {
+        for (Slot& slot : stream->slots) {
+            if (slot.fence)
+                glExt.DeleteSync(slot.fence);
+            if (slot.texture)
+                glDeleteTextures(1, &slot.texture);
+        }
+        if (stream->pbo)
+            glExt.DeleteBuffers(1, &stream->pbo);
+    }
+    streams.clear();
+
+    if (context) {
+        glfwDestroyWindow(context);
+        context = nullptr;
+    }
+}
+
+int UploadThread::AddStream(int width, int height) {
+    auto stream = std::make_unique<Stream>();
+    stream->width = width;
+    stream->height = height;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stream->id = (int)streams.size();
+    streams.push_back(std::move(stream));
+    return (int)streams.size() - 1;
+}
+
+bool UploadThread::Submit(int id, PixelBuffer* pixels, int64_t pts) {
+    bool replaced;
+    [[maybe_unused]] int64_t replacedPts;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stream& stream = *streams[id];
+        replaced = stream.hasPending;
+        replacedPts = stream.pendingPts;
+        stream.pending.swap(*pixels);
+        stream.pendingPts = pts;
+        stream.hasPending = true;
+    }
+    wake.notify_one();
+
+    if (replaced) {
+        framesDropped++;
+        PROFILE_DROP(Stage::Upload);
+        PROBE_FRAME_DROPPED((int)Stage::Upload, replacedPts);
+    }
+    return !replaced;
+}
+
+bool UploadThread::Acquire(int id, UploadedTexture* out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stream& stream = *streams[id];
+    out->fresh = false;
+
+    if (stream.ready >= 0) {
+        /* Draws already issued with the old texture must finish before it is rewritten */
+        if (stream.displayed >= 0) {
+            Slot& old = stream.slots[stream.displayed];
+            old.fence = glExt.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            /* Flush before freeing the slot, a fence from another context may never signal until flushed */
+            glFlush();
+            old.state = SlotState::Free;
+        }
+
+        Slot& slot = stream.slots[stream.ready];
+        glExt.WaitSync(slot.fence, 0, GL_TIMEOUT_IGNORED);
+        glExt.DeleteSync(slot.fence);
+        slot.fence = nullptr;
+        slot.state = SlotState::Displayed;
+        stream.displayed = stream.ready;
+        stream.ready = -1;
+        out->fresh = true;
+    }
+
+    if (stream.displayed < 0)
+        return false;
+
+    out->texture = stream.slots[stream.displayed].texture;
+    out->width = stream.width;
+    out->height = stream.height;
+    out->pts = stream.slots[stream.displayed].pts;
+    return true;
+}
+
+int UploadThread::QueuedFrames() {
+    std::lock_guard<std::mutex> lock(mutex);
+    int queued = 0;
+    for (auto& stream : streams)
+        queued += (stream->hasPending ? 1 : 0) + (stream->ready >= 0 ? 1 : 0);
+    return queued;
+}
+
+void UploadThread::UploadLoop() {
+    TRACE_THREAD_NAME("upload");
+    glfwMakeContextCurrent(context);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    /* Queries live in this context, so the timers belong to this thread */
+    GpuTimers gpuTimers;
+#if FFMPEG_DEMO_PROFILE
+    gpuTimers.Init();
+#endif
+
+    PixelBuffer pixels;
+    for (;;) {
+        Stream* stream = nullptr;
+        Slot* slot = nullptr;
+        int slotIndex = -1;
+        int64_t pts;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] {
+                if (stopping)
+                    return true;
+                for (auto& s : streams)
+                    if (s->hasPending)
+                        return true;
+                return false;
+            });
+            if (stopping)
+                break;
+
+            /* Round robin so one busy stream can't starve the rest */
+            for (size_t i = 0; i < streams.size(); i++) {
+                Stream* candidate = streams[(nextStream + i) % streams.size()].get();
+                if (candidate->hasPending) {
+                    stream = candidate;
+                    nextStream = (nextStream + i + 1) % streams.size();
+                    break;
+                }
+            }
+
+            pixels.swap(stream->pending);
+            pts = stream->pendingPts;
+            stream->hasPending = false;
+
+            for (int i = 0; i < 3; i++) {
+                if (stream->slots[i].state == SlotState::Free) {
+                    slotIndex = i;
+                    break;
+                }
+            }
+            slot = &stream->slots[slotIndex];
+            slot->state = SlotState::Writing;
+        }
+
+        if (slot->fence) {
+            glExt.WaitSync(slot->fence, 0, GL_TIMEOUT_IGNORED);
+            glExt.DeleteSync(slot->fence);
+            slot->fence = nullptr;
+        }
+
+        gpuTimers.Begin(Stage::GpuUpload);
+        Upload(*stream, *slot, pixels, pts);
+        gpuTimers.End();
+        GLsync fence = glExt.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stream->ready >= 0) {
+                /* Superseded before the render thread picked it up, it was never drawn */
+                Slot& stale = stream->slots[stream->ready];
+                glExt.DeleteSync(stale.fence);
+                stale.fence = nullptr;
+                stale.state = SlotState::Free;
+                framesDropped++;
+                PROFILE_DROP(Stage::Upload);
+                PROBE_FRAME_DROPPED((int)Stage::Upload, stale.pts);
+            }
+            slot->fence = fence;
+            slot->pts = pts;
+            slot->state = SlotState::Ready;
+            stream->ready = slotIndex;
+        }
+        framesUploaded++;
+        gpuTimers.Collect();
+    }
+
+    gpuTimers.Shutdown();
+    glfwMakeContextCurrent(NULL);
+}
+
+void UploadThread::Upload(Stream& stream, Slot& slot, const PixelBuffer& pixels, int64_t pts) {
+    PROFILE_SCOPE(Stage::Upload);
+    TRACE_SCOPE("upload", -1, pts);
+    const GLsizeiptr size = (GLsizeiptr)stream.width * stream.height * 3;
+
+    if (!slot.texture) {
+        glGenTextures(1, &slot.texture);
+        glBindTexture(GL_TEXTURE_2D, slot.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, stream.width, stream.height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        stream.gpuBytes.Add(MemoryStats::TextureBytes(stream.width, stream.height));
+    }
+    if (!stream.pbo) {
+        glExt.GenBuffers(1, &stream.pbo);
+        stream.gpuBytes.Add(size);
+    }
+
+    /* Orphan the previous storage so mapping never waits on an earlier transfer */
+    glExt.BindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.pbo);
+    glExt.BufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    void* mapped = glExt.MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped) {
+        memcpy(mapped, pixels.data(), (size_t)size < pixels.size() ? (size_t)size : pixels.size());
+        glExt.UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, slot.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, stream.width, stream.height, GL_RGB, GL_UNSIGNED_BYTE, (const void*)0);
+    glExt.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    PROBE_TEXTURE_UPLOADED(stream.id, pts, size);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gl_ext.h"
+#include "memory_stats.h"
+
+struct UploadedTexture {
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+    int64_t pts = 0;
+    bool fresh = false;     // swapped in by this Acquire call
+};
+
+/*
+ * Owns a hidden GL context that shares objects with the main window and does
+ * all pixel transfers on its own thread. Every stream cycles through three
+ * textures: one on screen, one ready, one being written. The render thread
+ * only ever issues a server-side wait on the fence of the ready texture.
+ */
+class UploadThread {
+public:
+    UploadThread() = default;
+    UploadThread(const UploadThread&) = delete;
+    UploadThread& operator=(const UploadThread&) = delete;
+    ~UploadThread();
+
+    /* Creates the shared context, must run on the main thread like every GLFW window call */
+    bool Start(GLFWwindow* sharedWith);
+    /* Joins the thread and frees the GL objects, needs the main context current */
+    void Stop();
+    bool IsRunning() const { return worker.joinable(); }
+
+    int AddStream(int width, int height);
+
+    /*
+     * Queues tightly packed RGB pixels by swapping buffers, pixels comes back
+     * holding a spare to decode into. A frame still waiting is replaced and
+     * counted as dropped.
+     */
+    bool Submit(int stream, PixelBuffer* pixels, int64_t pts);
+
+    /* Render thread: swaps in the newest uploaded texture, false until the first one lands */
+    bool Acquire(int stream, UploadedTexture* out);
+
+    /* Frames submitted or uploaded but not yet on screen, over all streams */
+    int QueuedFrames();
+
+    uint64_t FramesUploaded() const { return framesUploaded.load(); }
+    uint64_t FramesDropped() const { return framesDropped.load(); }
+
+private:
+    enum class SlotState { Free, Writing, Ready, Displayed };
+
+    struct Slot {
+        GLuint texture = 0;
+        GLsync fence = nullptr;     // upload done while Ready, last draw done while Free
+        SlotState state = SlotState::Free;
+        int64_t pts = 0;
+    };
+
+    struct Stream {
+        int id = 0;
+        int width = 0;
+        int height = 0;
+        Slot slots[3];
+        GLuint pbo = 0;
+        PixelBuffer pending;
+        int64_t pendingPts = 0;
+        bool hasPending = false;
+        int ready = -1;
+        int displayed = -1;
+        MemoryCharge gpuBytes{MemoryCategory::Textures};    // slot textures and the PBO
+    };
+
+    void UploadLoop();
+    void Upload(Stream& stream, Slot& slot, const PixelBuffer& pixels, int64_t pts);
+
+    GLFWwindow* context = nullptr;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    std::vector<std::unique_ptr<Stream>> streams;
+    size_t nextStream = 0;
+
+    std::atomic<uint64_t> framesUploaded{0};
+    std::atomic<uint64_t> framesDropped{0};
+};
@@ -0,0 +1,181 @@
+#include "video_reader.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "probes.h"
+#include "profiler.h"
+#include "tracer.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+VideoReader::~VideoReader() {
+    Close();
+}
+
+bool VideoReader::Open(const char* filename, int maxWidth, int maxHeight) {
+    if (avformat_open_input(&formatCtx, filename, NULL, NULL) < 0) {
+        printf("Couldn't open %s\n", filename);
+        return false;
+    }
+    if (avformat_find_stream_info(formatCtx, NULL) < 0) {
+        printf("Couldn't read stream info from %s\n", filename);
+        Close();
+        return false;
+    }
+
+    const AVCodec* codec = NULL;
+    streamIndex = av_find_best_stream(formatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (streamIndex < 0 || !codec) {
+        printf("No decodable video stream in %s\n", filename);
+        Close();
+        return false;
+    }
+
+    AVStream* stream = formatCtx->streams[streamIndex];
+    codecCtx = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(codecCtx, stream->codecpar);
+    codecCtx->thread_count = 1;
+
+    const int sourceWidth = stream->codecpar->width;
+    const int sourceHeight = stream->codecpar->height;
+    width = sourceWidth;
+    height = sourceHeight;
+    lowres = 0;
+    if (maxWidth > 0 && maxHeight > 0 && (sourceWidth > maxWidth || sourceHeight > maxHeight)) {
+        double scale = fmin((double)maxWidth / sourceWidth, (double)maxHeight / sourceHeight);
+        width = (int)(sourceWidth * scale) > 1 ? (int)(sourceWidth * scale) : 1;
+        height = (int)(sourceHeight * scale) > 1 ? (int)(sourceHeight * scale) : 1;
+
+        /* Every lowres step halves both sides, stop before dropping below the output size */
+        while (lowres < codec->max_lowres &&
+               (sourceWidth >> (lowres + 1)) >= width && (sourceHeight >> (lowres + 1)) >= height)
+            lowres++;
+        codecCtx->lowres = lowres;
+    }
+
+    if (avcodec_open2(codecCtx, codec, NULL) < 0) {
+        printf("Couldn't open decoder %s\n", codec->name);
+        Close();
+        return false;
+    }
+
+    AVRational rate = stream->avg_frame_rate;
+    if (rate.num <= 0 || rate.den <= 0)
+        rate = AVRational{25, 1};
+    frameDuration = av_rescale_q(1, AVRational{rate.den, rate.num}, AVRational{1, AV_TIME_BASE});
+
+    frame = av_frame_alloc();
+    packet = av_packet_alloc();
+    return true;
+}
+
+void VideoReader::Close() {
+    sws_freeContext(swsCtx);
+    swsCtx = nullptr;
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    packetBytes.Set(0);
+    frameBytes.Set(0);
+    avcodec_free_context(&codecCtx);
+    avformat_close_input(&formatCtx);
+    streamIndex = -1;
+}
+
+bool VideoReader::Rewind() {
+    if (av_seek_frame(formatCtx, streamIndex, 0, AVSEEK_FLAG_BACKWARD) < 0)
+        return false;
+    avcodec_flush_buffers(codecCtx);
+    draining = false;
+    ptsOffset = lastPts + frameDuration;
+    return true;
+}
+
+bool VideoReader::ReadFrame(PixelBuffer* rgb, int64_t* ptsMicros) {
+    if (!codecCtx)
+        return false;
+
+    TRACE_MARK(decodeStart);
+    PROFILE_ACCUMULATOR(demuxTime, Stage::Demux);
+    PROFILE_ACCUMULATOR(decodeTime, Stage::Decode);
+
+    bool rewound = false;
+    for (;;) {
+        PROFILE_BEGIN(decodeTime);
+        int ret = avcodec_receive_frame(codecCtx, frame);
+        PROFILE_END(decodeTime);
+        if (ret >= 0)
+            break;
+
+        if (ret == AVERROR_EOF) {
+            /* A second rewind without producing a frame means there is nothing to play */
+            if (rewound || !Rewind())
+                return false;
+            rewound = true;
+            continue;
+        }
+        if (ret != AVERROR(EAGAIN))
+            return false;
+
+        if (draining)
+            return false;
+
+        /* Nested inside the decode span, so reading packets shows apart from decoding them */
+        TRACE_MARK(demuxStart);
+        PROFILE_BEGIN(demuxTime);
+        ret = av_read_frame(formatCtx, packet);
+        PROFILE_END(demuxTime);
+        TRACE_COMPLETE("demux", demuxStart, framesRead, -1);
+        if (ret == AVERROR_EOF) {
+            avcodec_send_packet(codecCtx, NULL);
+            draining = true;
+            continue;
+        }
+        if (ret < 0)
+            return false;
+
+        packetBytes.Set(packet->buf ? packet->buf->size : packet->size);
+        if (packet->stream_index == streamIndex) {
+            PROFILE_BEGIN(decodeTime);
+            avcodec_send_packet(codecCtx, packet);
+            PROFILE_END(decodeTime);
+        }
+        av_packet_unref(packet);
+        packetBytes.Set(0);
+    }
+
+    int64_t referenced = 0;
+    for (AVBufferRef* buffer : frame->buf)
+        referenced += buffer ? buffer->size : 0;
+    frameBytes.Set(referenced);
+
+    AVRational timeBase = formatCtx->streams[streamIndex]->time_base;
+    int64_t pts = frame->best_effort_timestamp;
+    pts = pts == AV_NOPTS_VALUE ? lastPts + frameDuration : ptsOffset + av_rescale_q(pts, timeBase, AVRational{1, AV_TIME_BASE});
+    lastPts = pts;
+    *ptsMicros = pts;
+    TRACE_COMPLETE("decode", decodeStart, framesRead, pts);
+    PROBE_FRAME_DECODED(pts, frame->width, frame->height);
+
+    PROFILE_SCOPE(Stage::Convert);
+    TRACE_SCOPE("convert", framesRead, pts);
+
+    /* Scaling happens inside the conversion pass, only displayed pixels are written */
+    const int flags = frame->width > width * 2 || frame->height > height * 2 ? SWS_AREA : SWS_BILINEAR;
+    swsCtx = sws_getCachedContext(swsCtx, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                  width, height, AV_PIX_FMT_RGB24, flags, NULL, NULL, NULL);
+    rgb->resize((size_t)width * height * 3);
+    uint8_t* dst[4] = { rgb->data(), NULL, NULL, NULL };
+    int dstStride[4] = { width * 3, 0, 0, 0 };
+    sws_scale(swsCtx, frame->data, frame->linesize, 0, frame->height, dst, dstStride);
+    PROBE_FRAME_CONVERTED(pts, rgb->size());
+
+    av_frame_unref(frame);
+    frameBytes.Set(0);
+    framesRead++;
+    return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "memory_stats.h"
+
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+/*
+ * Demuxes and decodes one video stream into tightly packed RGB24 frames.
+ * The decoder runs single threaded on purpose: readers are driven from a
+ * shared ThreadPool, so parallelism comes from running many of them at once.
+ */
+class VideoReader {
+public:
+    VideoReader() = default;
+    VideoReader(const VideoReader&) = delete;
+    VideoReader& operator=(const VideoReader&) = delete;
+    ~VideoReader();
+
+    /*
+     * Frames come out no larger than maxWidth x maxHeight with the aspect ratio
+     * kept, 0 keeps the source size. The decoder's lowres mode takes the first
+     * power of two where the codec supports it, the converter scales the rest.
+     */
+    bool Open(const char* filename, int maxWidth = 0, int maxHeight = 0);
+    void Close();
+
+    /* Decodes the next frame, wrapping to the start at the end of the file. Timestamps keep increasing across loops */
+    bool ReadFrame(PixelBuffer* rgb, int64_t* ptsMicros);
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+private:
+    bool Rewind();
+
+    AVFormatContext* formatCtx = nullptr;
+    AVCodecContext* codecCtx = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;
+    SwsContext* swsCtx = nullptr;
+    int streamIndex = -1;
+    int width = 0;
+    int height = 0;
+    int lowres = 0;
+
+    bool draining = false;
+    int64_t ptsOffset = 0;
+    int64_t lastPts = 0;
+    int64_t frameDuration = 0;
+    int64_t framesRead = 0;
+
+    /* Buffers the packet and frame currently reference */
+    MemoryCharge packetBytes{MemoryCategory::Packets};
+    MemoryCharge frameBytes{MemoryCategory::Frames};
+};
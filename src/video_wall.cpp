@@ -0,0 +1,227 @@
+#include "video_wall.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "probes.h"
+#include "profiler.h"
+#include "tracer.h"
+
+VideoWall::~VideoWall() {
+    Close();
+}
+
+void VideoWall::GridSize(int count, int* columns, int* rows) {
+    *columns = count > 0 ? (int)ceil(sqrt((double)count)) : 1;
+    *rows = count > 0 ? (count + *columns - 1) / *columns : 1;
+}
+
+bool VideoWall::Open(const std::vector<const char*>& filenames, int threadCount, UploadThread* wallUploader,
+                     int windowWidth, int windowHeight) {
+    uploader = wallUploader;
+
+    /* Decode no more pixels than a cell can show */
+    int columns, rows;
+    GridSize((int)filenames.size(), &columns, &rows);
+    int cellWidth = windowWidth / columns;
+    int cellHeight = windowHeight / rows;
+
+    std::vector<const char*> opened;
+    for (const char* filename : filenames) {
+        auto tile = std::make_unique<Tile>();
+        if (!tile->reader.Open(filename, cellWidth, cellHeight))
+            continue;
+        tiles.push_back(std::move(tile));
+        opened.push_back(filename);
+    }
+
+    /* The grid only holds the streams that opened, reopen them for the larger cells they get */
+    for (;;) {
+        if (tiles.empty())
+            return false;
+        GridSize((int)tiles.size(), &columns, &rows);
+        if (windowWidth / columns == cellWidth && windowHeight / rows == cellHeight)
+            break;
+        cellWidth = windowWidth / columns;
+        cellHeight = windowHeight / rows;
+        for (size_t i = 0; i < tiles.size();) {
+            tiles[i]->reader.Close();
+            if (tiles[i]->reader.Open(opened[i], cellWidth, cellHeight)) {
+                i++;
+                continue;
+            }
+            tiles.erase(tiles.begin() + i);
+            opened.erase(opened.begin() + i);
+        }
+    }
+
+    if (uploader) {
+        for (auto& tile : tiles)
+            tile->stream = uploader->AddStream(tile->reader.Width(), tile->reader.Height());
+    }
+
+    /* Copying uploaded textures into array layers needs glCopyImageSubData */
+    instanced = renderer.Init() && (!uploader || glExt.CopyImageSubData);
+    if (instanced) {
+        for (auto& tile : tiles)
+            tile->rendererTile = renderer.AddTile(tile->reader.Width(), tile->reader.Height());
+        renderer.Build();
+    } else {
+        renderer.Shutdown();
+    }
+
+    ThreadPool::SetSharedThreadCount(threadCount);
+    pool = &ThreadPool::Shared();
+    printf("Video wall: %d streams on %d decode threads\n", (int)tiles.size(), pool->ThreadCount());
+
+    startTime = Clock::now();
+    for (auto& tile : tiles)
+        ScheduleDecode(*tile);
+    return true;
+}
+
+void VideoWall::Close() {
+    /* Running decode tasks reference the tiles, let them finish first */
+    if (pool)
+        pool->Wait();
+    pool = nullptr;
+
+    for (auto& tile : tiles) {
+        if (tile->texture)
+            glDeleteTextures(1, &tile->texture);
+        tile->textureBytes.Set(0);
+    }
+    tiles.clear();
+    renderer.Shutdown();
+    instanced = false;
+}
+
+int VideoWall::DecodesInFlight() const {
+    int busy = 0;
+    for (auto& tile : tiles)
+        busy += tile->busy.load(std::memory_order_relaxed) ? 1 : 0;
+    return busy;
+}
+
+void VideoWall::ScheduleDecode(Tile& tile) {
+    tile.busy.store(true, std::memory_order_relaxed);
+    pool->Submit([&tile] {
+        tile.hasDecoded = tile.reader.ReadFrame(&tile.decoded, &tile.decodedPts);
+        tile.failed = !tile.hasDecoded;
+        tile.busy.store(false, std::memory_order_release);
+    });
+}
+
+void VideoWall::Present(Tile& tile) {
+    TRACE_SCOPE("present", -1, tile.decodedPts);
+    if (uploader) {
+        /* Hands the frame over and gets a spare buffer back, so decoding doesn't allocate */
+        uploader->Submit(tile.stream, &tile.decoded, tile.decodedPts);
+        return;
+    }
+
+    PROFILE_SCOPE(Stage::Upload);
+    if (instanced) {
+        renderer.UpdateFromPixels(tile.rendererTile, tile.decoded.data());
+    } else {
+        if (!tile.texture) {
+            glGenTextures(1, &tile.texture);
+            glBindTexture(GL_TEXTURE_2D, tile.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        }
+        glBindTexture(GL_TEXTURE_2D, tile.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (!tile.textureAllocated) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tile.reader.Width(), tile.reader.Height(), 0, GL_RGB, GL_UNSIGNED_BYTE, tile.decoded.data());
+            tile.textureAllocated = true;
+            tile.textureBytes.Set(MemoryStats::TextureBytes(tile.reader.Width(), tile.reader.Height()));
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tile.reader.Width(), tile.reader.Height(), GL_RGB, GL_UNSIGNED_BYTE, tile.decoded.data());
+        }
+    }
+    /* Once the transfer is issued, as on the upload thread */
+    PROBE_TEXTURE_UPLOADED(-1, tile.decodedPts, tile.decoded.size());
+}
+
+void VideoWall::Update() {
+    int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - startTime).count();
+
+    for (auto& tilePtr : tiles) {
+        Tile& tile = *tilePtr;
+        if (tile.busy.load(std::memory_order_acquire) || tile.failed || !tile.hasDecoded)
+            continue;
+
+        /* Each stream keeps its own clock, anchored at its first frame */
+        if (!tile.clockStarted) {
+            tile.clockOffset = now - tile.decodedPts;
+            tile.clockStarted = true;
+        }
+        if (tile.decodedPts + tile.clockOffset > now)
+            continue;
+
+        Present(tile);
+        tile.hasDecoded = false;
+        ScheduleDecode(tile);
+    }
+}
+
+GLuint VideoWall::TileTexture(Tile& tile, bool* fresh) {
+    *fresh = false;
+    if (!uploader)
+        return tile.textureAllocated ? tile.texture : 0;
+
+    UploadedTexture uploaded;
+    if (!uploader->Acquire(tile.stream, &uploaded))
+        return 0;
+    *fresh = uploaded.fresh;
+    return uploaded.texture;
+}
+
+void VideoWall::Draw(int windowWidth, int windowHeight) {
+    if (tiles.empty())
+        return;
+
+    int columns, rows;
+    GridSize((int)tiles.size(), &columns, &rows);
+    const int cellWidth = windowWidth / columns;
+    const int cellHeight = windowHeight / rows;
+
+    if (!instanced)
+        glEnable(GL_TEXTURE_2D);
+    for (size_t i = 0; i < tiles.size(); i++) {
+        Tile& tile = *tiles[i];
+        bool fresh;
+        GLuint texture = TileTexture(tile, &fresh);
+
+        /* Fit the frame inside its cell keeping the aspect ratio, rows run top to bottom */
+        double scale = fmin((double)cellWidth / tile.reader.Width(), (double)cellHeight / tile.reader.Height());
+        int width = (int)(tile.reader.Width() * scale);
+        int height = (int)(tile.reader.Height() * scale);
+        int x = (int)(i % columns) * cellWidth + (cellWidth - width) / 2;
+        int y = windowHeight - (int)(i / columns + 1) * cellHeight + (cellHeight - height) / 2;
+
+        if (instanced) {
+            /* Only the layer of a tile with a new frame is touched */
+            if (fresh)
+                renderer.UpdateFromTexture(tile.rendererTile, texture);
+            renderer.SetRect(tile.rendererTile, (float)x, (float)y, (float)width, (float)height);
+            continue;
+        }
+
+        if (!texture)
+            continue;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glBegin(GL_QUADS);
+            glTexCoord2d(0.0, 1.0); glVertex2i(x, y);
+            glTexCoord2d(1.0, 1.0); glVertex2i(x + width, y);
+            glTexCoord2d(1.0, 0.0); glVertex2i(x + width, y + height);
+            glTexCoord2d(0.0, 0.0); glVertex2i(x, y + height);
+        glEnd();
+    }
+
+    if (instanced)
+        renderer.Draw(windowWidth, windowHeight);
+    else
+        glDisable(GL_TEXTURE_2D);
+}
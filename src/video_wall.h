@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "gl_ext.h"
+#include "thread_pool.h"
+#include "tile_renderer.h"
+#include "upload_thread.h"
+#include "video_reader.h"
+
+/*
+ * Plays several files at once in a grid. Every stream has its own reader,
+ * but all decoding runs as tasks on the shared ThreadPool so the thread
+ * count stays fixed however many feeds are on screen. Each stream decodes
+ * one frame ahead and the render thread releases it to the uploader once it
+ * is due. When the context allows it, all tiles are drawn by a TileRenderer
+ * in one instanced call instead of a bind and a quad per tile.
+ */
+class VideoWall {
+public:
+    VideoWall() = default;
+    VideoWall(const VideoWall&) = delete;
+    VideoWall& operator=(const VideoWall&) = delete;
+    ~VideoWall();
+
+    /*
+     * Without an uploader, frames are uploaded on the render thread. Streams
+     * are decoded at the size of their grid cell in a window of the given size.
+     * threadCount sizes the shared pool if nothing has started it yet.
+     */
+    bool Open(const std::vector<const char*>& filenames, int threadCount, UploadThread* uploader,
+              int windowWidth, int windowHeight);
+    void Close();
+
+    /* Columns and rows of the grid holding count tiles */
+    static void GridSize(int count, int* columns, int* rows);
+
+    /* Render thread, once per frame: presents due frames and schedules the next decodes */
+    void Update();
+    /* Draws every tile into a grid covering the window */
+    void Draw(int windowWidth, int windowHeight);
+
+    int TileCount() const { return (int)tiles.size(); }
+    /* Streams with a decode task queued or running on the pool */
+    int DecodesInFlight() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Tile {
+        VideoReader reader;
+        int stream = -1;
+        int rendererTile = -1;
+        GLuint texture = 0;
+        bool textureAllocated = false;
+        MemoryCharge textureBytes{MemoryCategory::Textures};
+
+        /* Owned by the decode task while busy, by the render thread otherwise */
+        std::atomic<bool> busy{false};
+        PixelBuffer decoded;
+        int64_t decodedPts = 0;
+        bool hasDecoded = false;
+        bool failed = false;
+
+        bool clockStarted = false;
+        int64_t clockOffset = 0;
+    };
+
+    void ScheduleDecode(Tile& tile);
+    void Present(Tile& tile);
+    GLuint TileTexture(Tile& tile, bool* fresh);
+
+    std::vector<std::unique_ptr<Tile>> tiles;
+    ThreadPool* pool = nullptr;
+    UploadThread* uploader = nullptr;
+    TileRenderer renderer;
+    bool instanced = false;
+    Clock::time_point startTime;
+};
@@ -0,0 +1,463 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "media.h"
+#include "stb/stb_image.h"
+#include "video_reader.h"
+
+/*
+ * Decode regression tests for the stb_image paths the player and the
+ * benchmarks depend on. The images come from the benchmark media generator,
+ * so nothing binary lives in the repository: PNGs must give back the
+ * generated pattern exactly, JPEGs must agree with libavcodec's decode of
+ * the same file, and the scaled, cropped and streaming loads must agree
+ * with a plain full load. Exits 1 when any check fails.
+ */
+
+/* Not a multiple of the 16 pixel MCU either way, so partial blocks are covered */
+static const int ImageWidth = 360;
+static const int ImageHeight = 244;
+
+/* Mean absolute difference per sample allowed between two decoders of the same JPEG */
+static const double JpegTolerance = 3.0;
+/* ...and between a reduced IDCT and a box filter over the full decode */
+static const double ScaleTolerance = 4.0;
+
+static int failures = 0;
+
+static void Fail(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    printf("    ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    failures++;
+}
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<unsigned char> pixels;
+};
+
+static std::filesystem::path workDirectory;
+
+/* Writes a one frame pattern through WriteClip and reads the file back */
+static bool WriteImage(const char* name, int channels, std::vector<unsigned char>* file) {
+    ClipSettings settings;
+    settings.width = ImageWidth;
+    settings.height = ImageHeight;
+    settings.channels = channels;
+    settings.frames = 1;
+    const std::string path = (workDirectory / name).string();
+    if (!WriteClip(path.c_str(), settings)) {
+        Fail("couldn't write %s", path.c_str());
+        return false;
+    }
+
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) {
+        Fail("couldn't read back %s", path.c_str());
+        return false;
+    }
+    fseek(in, 0, SEEK_END);
+    file->resize((size_t)ftell(in));
+    fseek(in, 0, SEEK_SET);
+    bool ok = fread(file->data(), 1, file->size(), in) == file->size();
+    fclose(in);
+    return ok;
+}
+
+static bool Load(const std::vector<unsigned char>& file, int desiredChannels, Image* image) {
+    unsigned char* data = stbi_load_from_memory(file.data(), (int)file.size(), &image->width, &image->height,
+                                                &image->channels, desiredChannels);
+    if (!data) {
+        Fail("stb_image failed: %s", stbi_failure_reason());
+        return false;
+    }
+    if (desiredChannels)
+        image->channels = desiredChannels;
+    image->pixels.assign(data, data + (size_t)image->width * image->height * image->channels);
+    stbi_image_free(data);
+    return true;
+}
+
+static bool SameSize(const Image& a, const Image& b) {
+    return a.width == b.width && a.height == b.height && a.channels == b.channels;
+}
+
+static double MeanAbsDiff(const Image& a, const Image& b) {
+    double sum = 0.0;
+    for (size_t i = 0; i < a.pixels.size(); i++)
+        sum += abs((int)a.pixels[i] - (int)b.pixels[i]);
+    return a.pixels.empty() ? 0.0 : sum / (double)a.pixels.size();
+}
+
+static Image Window(const Image& image, int x, int y, int width, int height) {
+    Image window;
+    window.width = width;
+    window.height = height;
+    window.channels = image.channels;
+    const size_t rowBytes = (size_t)width * image.channels;
+    window.pixels.resize(rowBytes * height);
+    for (int row = 0; row < height; row++) {
+        const unsigned char* from = &image.pixels[((size_t)(y + row) * image.width + x) * image.channels];
+        memcpy(&window.pixels[row * rowBytes], from, rowBytes);
+    }
+    return window;
+}
+
+/* Each output pixel averages the factor x factor block under it, cut off at the right and bottom edges */
+static Image BoxDownsample(const Image& image, int factor) {
+    Image small;
+    small.width = (image.width + factor - 1) / factor;
+    small.height = (image.height + factor - 1) / factor;
+    small.channels = image.channels;
+    small.pixels.resize((size_t)small.width * small.height * small.channels);
+    for (int y = 0; y < small.height; y++) {
+        for (int x = 0; x < small.width; x++) {
+            for (int c = 0; c < image.channels; c++) {
+                int sum = 0, count = 0;
+                for (int sy = y * factor; sy < y * factor + factor && sy < image.height; sy++) {
+                    for (int sx = x * factor; sx < x * factor + factor && sx < image.width; sx++) {
+                        sum += image.pixels[((size_t)sy * image.width + sx) * image.channels + c];
+                        count++;
+                    }
+                }
+                small.pixels[((size_t)y * small.width + x) * small.channels + c] = (unsigned char)((sum + count / 2) / count);
+            }
+        }
+    }
+    return small;
+}
+
+static void TestPngFullDecode() {
+    for (int channels : {1, 3, 4}) {
+        std::vector<unsigned char> png;
+        if (!WriteImage("pattern.png", channels, &png))
+            continue;
+
+        Image decoded;
+        if (!Load(png, 0, &decoded))
+            continue;
+        if (decoded.width != ImageWidth || decoded.height != ImageHeight || decoded.channels != channels) {
+            Fail("%d channel PNG loaded as %dx%dx%d", channels, decoded.width, decoded.height, decoded.channels);
+            continue;
+        }
+
+        std::vector<unsigned char> pattern((size_t)ImageWidth * ImageHeight * channels);
+        FillPattern(pattern.data(), ImageWidth, ImageHeight, channels, 1);
+        if (decoded.pixels != pattern)
+            Fail("%d channel PNG doesn't match the pattern it was encoded from", channels);
+    }
+}
+
+static void TestJpegFullDecode() {
+    std::vector<unsigned char> jpeg;
+    if (!WriteImage("pattern.jpg", 3, &jpeg))
+        return;
+
+    Image decoded;
+    if (!Load(jpeg, 3, &decoded))
+        return;
+
+    /* The reference is the player's own libavcodec path at the source size */
+    const std::string path = (workDirectory / "pattern.jpg").string();
+    VideoReader reader;
+    PixelBuffer frame;
+    int64_t pts;
+    if (!reader.Open(path.c_str()) || !reader.ReadFrame(&frame, &pts)) {
+        Fail("libavcodec couldn't decode %s", path.c_str());
+        return;
+    }
+
+    Image reference;
+    reference.width = reader.Width();
+    reference.height = reader.Height();
+    reference.channels = 3;
+    reference.pixels.assign(frame.begin(), frame.end());
+    if (!SameSize(decoded, reference)) {
+        Fail("JPEG loaded as %dx%d, libavcodec gives %dx%d", decoded.width, decoded.height, reference.width, reference.height);
+        return;
+    }
+
+    double diff = MeanAbsDiff(decoded, reference);
+    if (diff > JpegTolerance)
+        Fail("JPEG differs from libavcodec by %.2f per sample, allowed %.2f", diff, JpegTolerance);
+}
+
+static void TestJpegScaledDecode() {
+    std::vector<unsigned char> jpeg;
+    Image full;
+    if (!WriteImage("pattern.jpg", 3, &jpeg) || !Load(jpeg, 3, &full))
+        return;
+
+    for (int factor : {2, 4, 8}) {
+        Image scaled;
+        stbi_set_jpeg_scale_on_load(factor);
+        bool loaded = Load(jpeg, 3, &scaled);
+        stbi_set_jpeg_scale_on_load(1);
+        if (!loaded)
+            continue;
+
+        Image expected = BoxDownsample(full, factor);
+        if (!SameSize(scaled, expected)) {
+            Fail("1/%d JPEG loaded as %dx%d, expected %dx%d", factor, scaled.width, scaled.height,
+                 expected.width, expected.height);
+            continue;
+        }
+        double diff = MeanAbsDiff(scaled, expected);
+        if (diff > ScaleTolerance)
+            Fail("1/%d JPEG differs from the downsampled full decode by %.2f per sample, allowed %.2f",
+                 factor, diff, ScaleTolerance);
+    }
+}
+
+static void TestJpegCroppedDecode() {
+    std::vector<unsigned char> jpeg;
+    if (!WriteImage("pattern.jpg", 3, &jpeg))
+        return;
+
+    /* Unaligned inside, a single pixel, and one running off the bottom right corner */
+    static const int rects[][4] = { {37, 21, 150, 99}, {200, 130, 1, 1}, {300, 180, 200, 200} };
+    for (int factor : {1, 2, 4, 8}) {
+        Image full;
+        stbi_set_jpeg_scale_on_load(factor);
+        bool loaded = Load(jpeg, 3, &full);
+        if (!loaded) {
+            stbi_set_jpeg_scale_on_load(1);
+            continue;
+        }
+
+        for (const auto& rect : rects) {
+            Image cropped;
+            stbi_set_jpeg_crop_on_load(rect[0], rect[1], rect[2], rect[3]);
+            loaded = Load(jpeg, 3, &cropped);
+            stbi_set_jpeg_crop_on_load(0, 0, 0, 0);
+            if (!loaded)
+                continue;
+
+            /* The crop clipped to the image, then scaled down rounding outwards */
+            const int x0 = rect[0] / factor, y0 = rect[1] / factor;
+            const int x1 = (std::min(rect[0] + rect[2], ImageWidth) + factor - 1) / factor;
+            const int y1 = (std::min(rect[1] + rect[3], ImageHeight) + factor - 1) / factor;
+            Image expected = Window(full, x0, y0, x1 - x0, y1 - y0);
+            if (!SameSize(cropped, expected))
+                Fail("1/%d crop at %d,%d loaded as %dx%d, expected %dx%d", factor, rect[0], rect[1],
+                     cropped.width, cropped.height, expected.width, expected.height);
+            else if (cropped.pixels != expected.pixels)
+                Fail("1/%d crop at %d,%d doesn't match the same window of the full decode", factor, rect[0], rect[1]);
+        }
+
+        /* A rectangle missing the image is an error, not an empty image */
+        Image outside;
+        stbi_set_jpeg_crop_on_load(ImageWidth + 8, 0, 16, 16);
+        unsigned char* data = stbi_load_from_memory(jpeg.data(), (int)jpeg.size(), &outside.width, &outside.height,
+                                                    &outside.channels, 3);
+        stbi_set_jpeg_crop_on_load(0, 0, 0, 0);
+        if (data) {
+            Fail("1/%d crop outside the image loaded", factor);
+            stbi_image_free(data);
+        }
+        stbi_set_jpeg_scale_on_load(1);
+    }
+}
+
+struct RowCollector {
+    int width = 0;
+    int channels = 0;
+    int nextRow = 0;
+    bool outOfOrder = false;
+    std::vector<unsigned char> pixels;
+};
+
+static void CollectRows(void* context, int y, int rows, const stbi_uc* pixels) {
+    RowCollector* collector = (RowCollector*)context;
+    if (y != collector->nextRow)
+        collector->outOfOrder = true;
+    collector->nextRow = y + rows;
+    collector->pixels.insert(collector->pixels.end(), pixels, pixels + (size_t)rows * collector->width * collector->channels);
+}
+
+/* Bands of rows must add up to the whole load, in order */
+static void CheckRows(const char* label, const std::vector<unsigned char>& file, int desiredChannels) {
+    Image whole;
+    if (!Load(file, desiredChannels, &whole))
+        return;
+
+    RowCollector collector;
+    collector.width = whole.width;
+    collector.channels = whole.channels;
+    int width, height, channels;
+    if (!stbi_load_rows_from_memory(file.data(), (int)file.size(), &width, &height, &channels, desiredChannels,
+                                    CollectRows, &collector)) {
+        Fail("%s: streaming load failed: %s", label, stbi_failure_reason());
+        return;
+    }
+    if (width != whole.width || height != whole.height)
+        Fail("%s: streaming load reported %dx%d, the whole load %dx%d", label, width, height, whole.width, whole.height);
+    else if (collector.outOfOrder || collector.nextRow != whole.height)
+        Fail("%s: rows didn't arrive once each from top to bottom", label);
+    else if (collector.pixels != whole.pixels)
+        Fail("%s: streamed rows don't match the whole load", label);
+}
+
+static void TestStreamingRows() {
+    std::vector<unsigned char> png, pngAlpha, jpeg;
+    if (WriteImage("pattern.png", 3, &png))
+        CheckRows("RGB PNG", png, 0);
+    if (WriteImage("pattern-rgba.png", 4, &pngAlpha))
+        CheckRows("RGBA PNG to RGB", pngAlpha, 3);
+    if (WriteImage("pattern.jpg", 3, &jpeg)) {
+        CheckRows("JPEG", jpeg, 3);
+        CheckRows("JPEG to gray", jpeg, 1);
+    }
+}
+
+static int PaethPredictor(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+/* Undoes the per-row PNG filters of an 8 bit image in place, returns false on an unknown filter */
+static bool Unfilter(const std::vector<unsigned char>& raw, int width, int height, int channels,
+                     std::vector<unsigned char>* pixels) {
+    const size_t stride = (size_t)width * channels;
+    pixels->assign(stride * height, 0);
+    for (int y = 0; y < height; y++) {
+        const unsigned char* in = &raw[y * (stride + 1) + 1];
+        unsigned char* out = &(*pixels)[y * stride];
+        const unsigned char* prior = y > 0 ? out - stride : nullptr;
+        for (size_t i = 0; i < stride; i++) {
+            int a = i >= (size_t)channels ? out[i - channels] : 0;
+            int b = prior ? prior[i] : 0;
+            int c = prior && i >= (size_t)channels ? prior[i - channels] : 0;
+            int predicted;
+            switch (raw[y * (stride + 1)]) {
+            case 0: predicted = 0; break;
+            case 1: predicted = a; break;
+            case 2: predicted = b; break;
+            case 3: predicted = (a + b) / 2; break;
+            case 4: predicted = PaethPredictor(a, b, c); break;
+            default: return false;
+            }
+            out[i] = (unsigned char)(in[i] + predicted);
+        }
+    }
+    return true;
+}
+
+static uint32_t Adler32(const unsigned char* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < size; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return b << 16 | a;
+}
+
+static void CheckInflate(const char* label, const std::vector<unsigned char>& stream, const std::string& expected) {
+    int length = 0;
+    char* data = stbi_zlib_decode_malloc_guesssize((const char*)stream.data(), (int)stream.size(), 1, &length);
+    if (!data) {
+        Fail("%s: inflate failed: %s", label, stbi_failure_reason());
+        return;
+    }
+    if (std::string(data, length) != expected)
+        Fail("%s: inflated %d bytes that don't match the %d expected", label, length, (int)expected.size());
+    stbi_image_free(data);
+}
+
+static void TestPngInflate() {
+    for (int channels : {3, 4}) {
+        std::vector<unsigned char> png;
+        if (!WriteImage(channels == 4 ? "pattern-rgba.png" : "pattern.png", channels, &png))
+            continue;
+
+        std::vector<unsigned char> stream = PngZlibStream(png);
+        const int rawSize = ImageHeight * (1 + ImageWidth * channels);
+        int length = 0;
+        char* raw = stbi_zlib_decode_malloc_guesssize((const char*)stream.data(), (int)stream.size(), rawSize / 4, &length);
+        if (!raw) {
+            Fail("%d channel IDAT stream didn't inflate: %s", channels, stbi_failure_reason());
+            continue;
+        }
+        std::vector<unsigned char> filtered(raw, raw + length);
+        stbi_image_free(raw);
+        if (length != rawSize) {
+            Fail("%d channel IDAT stream inflated to %d bytes, expected %d", channels, length, rawSize);
+            continue;
+        }
+
+        std::vector<unsigned char> pixels, pattern((size_t)ImageWidth * ImageHeight * channels);
+        FillPattern(pattern.data(), ImageWidth, ImageHeight, channels, 1);
+        if (!Unfilter(filtered, ImageWidth, ImageHeight, channels, &pixels) || pixels != pattern)
+            Fail("%d channel IDAT stream doesn't unfilter to the pattern", channels);
+
+        /* An exact size buffer takes it, one byte less must be refused */
+        std::vector<char> buffer(rawSize);
+        if (stbi_zlib_decode_buffer(buffer.data(), rawSize, (const char*)stream.data(), (int)stream.size()) != rawSize ||
+            memcmp(buffer.data(), filtered.data(), rawSize) != 0)
+            Fail("%d channel IDAT stream didn't inflate into an exact size buffer", channels);
+        if (stbi_zlib_decode_buffer(buffer.data(), rawSize - 1, (const char*)stream.data(), (int)stream.size()) != -1)
+            Fail("%d channel IDAT stream inflated into a buffer one byte short", channels);
+    }
+
+    /* FFmpeg's encoder writes dynamic Huffman blocks, the other two block types are covered by hand */
+    const std::string text = "stb_image inflates fixed Huffman blocks, stb_image inflates fixed Huffman blocks, ";
+    std::vector<unsigned char> stored = { 0x78, 0x01, 0x01, (unsigned char)text.size(), 0x00,
+                                          (unsigned char)~text.size(), 0xff };
+    stored.insert(stored.end(), text.begin(), text.end());
+    const uint32_t adler = Adler32((const unsigned char*)text.data(), text.size());
+    for (int shift = 24; shift >= 0; shift -= 8)
+        stored.push_back((unsigned char)(adler >> shift));
+    CheckInflate("stored block", stored, text);
+
+    /* zlib level 9 of the same text, one fixed Huffman block repeating its first half by a match */
+    const std::vector<unsigned char> fixed = {
+        0x78, 0xda, 0x2b, 0x2e, 0x49, 0x8a, 0xcf, 0xcc, 0x4d, 0x4c, 0x4f, 0x55, 0xc8, 0xcc, 0x4b, 0xcb, 0x49, 0x2c,
+        0x49, 0x2d, 0x56, 0x48, 0xcb, 0xac, 0x48, 0x4d, 0x51, 0xf0, 0x28, 0x4d, 0x4b, 0xcb, 0x4d, 0xcc, 0x53, 0x48,
+        0xca, 0xc9, 0x4f, 0xce, 0x2e, 0xd6, 0x51, 0x28, 0x26, 0x56, 0x21, 0x00, 0xfe, 0x48, 0x1e, 0x41,
+    };
+    CheckInflate("fixed Huffman block", fixed, text);
+}
+
+int main(int argc, char** argv) {
+    std::error_code error;
+    workDirectory = std::filesystem::temp_directory_path(error) / "ffmpeg-demo-tests";
+    std::filesystem::create_directories(workDirectory, error);
+
+    struct { const char* name; void (*run)(); } tests[] = {
+        { "png_full_decode", TestPngFullDecode },
+        { "jpeg_full_decode", TestJpegFullDecode },
+        { "jpeg_scaled_decode", TestJpegScaledDecode },
+        { "jpeg_cropped_decode", TestJpegCroppedDecode },
+        { "streaming_rows", TestStreamingRows },
+        { "png_inflate", TestPngInflate },
+    };
+
+    int failedTests = 0;
+    for (const auto& test : tests) {
+        if (argc > 1 && strstr(test.name, argv[1]) == nullptr)
+            continue;
+        const int before = failures;
+        test.run();
+        printf("%s %s\n", failures == before ? "PASS" : "FAIL", test.name);
+        failedTests += failures == before ? 0 : 1;
+    }
+
+    std::filesystem::remove_all(workDirectory, error);
+    printf("%d failed\n", failedTests);
+    return failedTests ? 1 : 0;
+}